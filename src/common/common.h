@@ -40,7 +40,6 @@
 #define IMAGE_NORMALIZE         0x00001000 /* Histogram normalize wx image    */
 #define IMAGE_CLAHE             0x00002000 /* CLAHE image contrast enhance    */
 #define IMAGE_COLORIZE          0x00004000 /* Pseudo colorize wx image        */
-#define IMAGE_COLORIZED         0x00008000 /* Pseudo colorize wx image        */
 #define IMAGE_INVERT            0x00010000 /* Rotate wx image 180 degrees     */
 #define IMAGES_PROCESSED        0x00020000 /* Images have been processed OK   */
 #define IMAGE_RECTIFY           0x00040000 /* Rectify wx image                */
@@ -16,11 +16,11 @@
 
 #include "shared.h"
 
-#include "../decoder/huffman.h"
 #include "../decoder/met_to_data.h"
 #include "../glrpt/rc_config.h"
 #include "../sdr/filters.h"
 #include "common.h"
+#include "thread_pool.h"
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <glib.h>
@@ -120,11 +120,12 @@ filter_data_t filter_data_q;
 sem_t demod_semaphore;
 
 /* Meteor decoder variables */
-ac_table_rec_t *ac_table = NULL;
-size_t ac_table_len;
 mtd_rec_t mtd_record;
 
 /* Channel images and sizes */
 uint8_t *channel_image[CHANNEL_IMAGE_NUM];
 size_t   channel_image_size;
 uint32_t channel_image_width, channel_image_height;
+
+/* Worker threads for image decoding and processing */
+thread_pool_t *thread_pool = NULL;
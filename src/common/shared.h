@@ -19,11 +19,11 @@
 
 /*****************************************************************************/
 
-#include "../decoder/huffman.h"
 #include "../decoder/met_to_data.h"
 #include "../glrpt/rc_config.h"
 #include "../sdr/filters.h"
 #include "common.h"
+#include "thread_pool.h"
 
 #include <gdk-pixbuf/gdk-pixbuf.h>
 #include <glib.h>
@@ -123,8 +123,6 @@ extern filter_data_t filter_data_q;
 extern sem_t demod_semaphore;
 
 /* Meteor decoder variables */
-extern ac_table_rec_t *ac_table;
-extern size_t ac_table_len;
 extern mtd_rec_t mtd_record;
 
 /* Channel images and sizes */
@@ -132,6 +130,9 @@ extern uint8_t *channel_image[CHANNEL_IMAGE_NUM];
 extern size_t   channel_image_size;
 extern uint32_t channel_image_width, channel_image_height;
 
+/* Worker threads for image decoding and processing */
+extern thread_pool_t *thread_pool;
+
 /*****************************************************************************/
 
 #endif
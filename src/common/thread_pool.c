@@ -0,0 +1,303 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 3 of
+ *  the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details:
+ *
+ *  http://www.gnu.org/copyleft/gpl.txt
+ */
+
+/*****************************************************************************/
+
+#include "thread_pool.h"
+
+#include "../glrpt/utils.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*****************************************************************************/
+
+/* Initial number of job slots, doubled when full */
+#define POOL_QUEUE_LEN  64
+
+/*****************************************************************************/
+
+/* One index of a parallel loop */
+typedef struct pool_for_job_t {
+    pool_for_t func;
+    void      *arg;
+    int        idx;
+} pool_for_job_t;
+
+typedef struct pool_slot_t {
+    pool_job_t func;
+    void      *arg;
+} pool_slot_t;
+
+struct thread_pool_t {
+    pthread_mutex_t lock;
+    pthread_cond_t  job_ready;  /* Signalled when a job is queued   */
+    pthread_cond_t  all_done;   /* Signalled when no jobs are left  */
+
+    pool_slot_t *queue;         /* Ring of queued jobs              */
+    int queue_len, head, count;
+
+    int  pending;               /* Jobs queued or running           */
+    bool stop;
+
+    pthread_t *threads;
+    int num_threads;
+};
+
+/*****************************************************************************/
+
+static void Pool_Error(const char *msg);
+static void Pool_Grow_Queue(thread_pool_t *pool);
+static void *Pool_Worker(void *data);
+static void Pool_For_Job(void *arg);
+
+/*****************************************************************************/
+
+/* Pool_Error()
+ *
+ * Reports a failure to set up the pool and exits, like mem_alloc()
+ */
+static void Pool_Error(const char *msg) {
+  perror( msg );
+  exit( -1 );
+}
+
+/*****************************************************************************/
+
+/* Pool_Grow_Queue()
+ *
+ * Doubles the job ring, unwrapping the queued jobs to its start.
+ * Called with the pool locked
+ */
+static void Pool_Grow_Queue(thread_pool_t *pool) {
+  pool_slot_t *queue = NULL;
+  int i, len;
+
+  len = 2 * pool->queue_len;
+  mem_alloc( (void **)&queue, (size_t)len * sizeof(pool_slot_t) );
+  for( i = 0; i < pool->count; i++ )
+    queue[i] = pool->queue[(pool->head + i) % pool->queue_len];
+
+  free_ptr( (void **)&pool->queue );
+  pool->queue     = queue;
+  pool->queue_len = len;
+  pool->head      = 0;
+}
+
+/*****************************************************************************/
+
+/* Pool_Worker()
+ *
+ * Worker thread, runs queued jobs in order until the pool stops
+ */
+static void *Pool_Worker(void *data) {
+  thread_pool_t *pool = (thread_pool_t *)data;
+  pool_slot_t job;
+
+  pthread_mutex_lock( &pool->lock );
+  while( true )
+  {
+    while( (pool->count == 0) && !pool->stop )
+      pthread_cond_wait( &pool->job_ready, &pool->lock );
+
+    if( pool->count == 0 )
+      break;
+
+    job = pool->queue[pool->head];
+    pool->head = ( pool->head + 1 ) % pool->queue_len;
+    pool->count--;
+    pthread_mutex_unlock( &pool->lock );
+
+    job.func( job.arg );
+
+    pthread_mutex_lock( &pool->lock );
+    pool->pending--;
+    if( pool->pending == 0 )
+      pthread_cond_broadcast( &pool->all_done );
+  }
+  pthread_mutex_unlock( &pool->lock );
+
+  return( NULL );
+}
+
+/*****************************************************************************/
+
+/* Pool_Init()
+ *
+ * Starts a pool of num_threads workers, or of one per online
+ * CPU if num_threads is 0, limited to POOL_MAX_THREADS
+ */
+thread_pool_t *Pool_Init(int num_threads) {
+  thread_pool_t *pool = NULL;
+  int i;
+
+  if( num_threads <= 0 )
+    num_threads = (int)sysconf( _SC_NPROCESSORS_ONLN );
+  if( num_threads < 1 ) num_threads = 1;
+  if( num_threads > POOL_MAX_THREADS ) num_threads = POOL_MAX_THREADS;
+
+  mem_alloc( (void **)&pool, sizeof(thread_pool_t) );
+  pthread_mutex_init( &pool->lock, NULL );
+  pthread_cond_init( &pool->job_ready, NULL );
+  pthread_cond_init( &pool->all_done, NULL );
+
+  pool->queue_len = POOL_QUEUE_LEN;
+  mem_alloc( (void **)&pool->queue,
+      (size_t)pool->queue_len * sizeof(pool_slot_t) );
+
+  mem_alloc( (void **)&pool->threads,
+      (size_t)num_threads * sizeof(pthread_t) );
+  for( i = 0; i < num_threads; i++ )
+    if( pthread_create(&pool->threads[i], NULL, Pool_Worker, pool) != 0 )
+      Pool_Error( "glrpt: pthread_create()" );
+  pool->num_threads = num_threads;
+
+  return( pool );
+}
+
+/*****************************************************************************/
+
+/* Pool_Threads()
+ *
+ * Returns the number of worker threads of the pool
+ */
+int Pool_Threads(const thread_pool_t *pool) {
+  return( pool->num_threads );
+}
+
+/*****************************************************************************/
+
+/* Pool_Submit()
+ *
+ * Queues func(arg) to be run by the next free worker
+ */
+void Pool_Submit(thread_pool_t *pool, pool_job_t func, void *arg) {
+  int tail;
+
+  pthread_mutex_lock( &pool->lock );
+  if( pool->count == pool->queue_len )
+    Pool_Grow_Queue( pool );
+
+  tail = ( pool->head + pool->count ) % pool->queue_len;
+  pool->queue[tail].func = func;
+  pool->queue[tail].arg  = arg;
+  pool->count++;
+  pool->pending++;
+
+  pthread_cond_signal( &pool->job_ready );
+  pthread_mutex_unlock( &pool->lock );
+}
+
+/*****************************************************************************/
+
+/* Pool_Wait()
+ *
+ * Blocks until all the jobs submitted so far have finished.
+ * Must not be called from inside a job
+ */
+void Pool_Wait(thread_pool_t *pool) {
+  pthread_mutex_lock( &pool->lock );
+  while( pool->pending > 0 )
+    pthread_cond_wait( &pool->all_done, &pool->lock );
+  pthread_mutex_unlock( &pool->lock );
+}
+
+/*****************************************************************************/
+
+/* Pool_For_Job()
+ *
+ * Runs one index of a parallel loop
+ */
+static void Pool_For_Job(void *arg) {
+  pool_for_job_t *job = (pool_for_job_t *)arg;
+
+  job->func( job->arg, job->idx );
+}
+
+/*****************************************************************************/
+
+/* Pool_For()
+ *
+ * Runs func(arg, idx) for idx from 0 to count - 1 on the workers
+ * and returns when all have finished. Like Pool_Wait(), it also
+ * waits for any other jobs and must not be called from a job
+ */
+void Pool_For(thread_pool_t *pool, int count, pool_for_t func, void *arg) {
+  pool_for_job_t *jobs = NULL;
+  int idx;
+
+  if( count <= 0 ) return;
+
+  mem_alloc( (void **)&jobs, (size_t)count * sizeof(pool_for_job_t) );
+  for( idx = 0; idx < count; idx++ )
+  {
+    jobs[idx].func = func;
+    jobs[idx].arg  = arg;
+    jobs[idx].idx  = idx;
+    Pool_Submit( pool, Pool_For_Job, &jobs[idx] );
+  }
+
+  Pool_Wait( pool );
+  free_ptr( (void **)&jobs );
+}
+
+/*****************************************************************************/
+
+/* Pool_Strips()
+ *
+ * Returns the number of strips to split len items (rows, pixels)
+ * into for a parallel loop, a few per worker for load balancing
+ * but none shorter than min_len
+ */
+int Pool_Strips(const thread_pool_t *pool, int len, int min_len) {
+  int strips = 4 * pool->num_threads;
+
+  if( min_len < 1 ) min_len = 1;
+  if( strips > len / min_len ) strips = len / min_len;
+  if( strips < 1 ) strips = 1;
+
+  return( strips );
+}
+
+/*****************************************************************************/
+
+/* Pool_Deinit()
+ *
+ * Finishes the queued jobs, stops the workers and frees the pool
+ */
+void Pool_Deinit(thread_pool_t **pool) {
+  thread_pool_t *p = *pool;
+  int i;
+
+  if( p == NULL ) return;
+
+  pthread_mutex_lock( &p->lock );
+  p->stop = true;
+  pthread_cond_broadcast( &p->job_ready );
+  pthread_mutex_unlock( &p->lock );
+
+  for( i = 0; i < p->num_threads; i++ )
+    pthread_join( p->threads[i], NULL );
+
+  pthread_mutex_destroy( &p->lock );
+  pthread_cond_destroy( &p->job_ready );
+  pthread_cond_destroy( &p->all_done );
+  free_ptr( (void **)&p->threads );
+  free_ptr( (void **)&p->queue );
+  free_ptr( (void **)pool );
+}
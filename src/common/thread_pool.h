@@ -0,0 +1,48 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 3 of
+ *  the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details:
+ *
+ *  http://www.gnu.org/copyleft/gpl.txt
+ */
+
+/*****************************************************************************/
+
+#ifndef COMMON_THREAD_POOL_H
+#define COMMON_THREAD_POOL_H
+
+/*****************************************************************************/
+
+/* Upper limit of worker threads in a pool */
+#define POOL_MAX_THREADS    16
+
+/*****************************************************************************/
+
+/* Job function run by a worker thread */
+typedef void (*pool_job_t)(void *arg);
+
+/* Job function run for each index of a parallel loop */
+typedef void (*pool_for_t)(void *arg, int idx);
+
+/* Pool of worker threads fed from a FIFO of jobs */
+typedef struct thread_pool_t thread_pool_t;
+
+/*****************************************************************************/
+
+thread_pool_t *Pool_Init(int num_threads);
+int Pool_Threads(const thread_pool_t *pool);
+void Pool_Submit(thread_pool_t *pool, pool_job_t func, void *arg);
+void Pool_Wait(thread_pool_t *pool);
+void Pool_For(thread_pool_t *pool, int count, pool_for_t func, void *arg);
+int Pool_Strips(const thread_pool_t *pool, int len, int min_len);
+void Pool_Deinit(thread_pool_t **pool);
+
+/*****************************************************************************/
+
+#endif
@@ -161,24 +161,35 @@ int Bitop_CountBits(uint32_t n) {
 
 /*****************************************************************************/
 
-uint32_t Bitop_PeekNBits(bit_io_rec_t *b, const int n) {
-    int bit, i, p;
-    uint32_t result = 0;
-
-    for (i = 0; i < n; i++) {
-        p = b->pos + i;
-        bit = (b->p[p >> 3] >> (7 - (p & 7))) & 0x01;
-        result = (result << 1) | (uint32_t)bit;
-    }
+/* Bitop_ReaderCreate()
+ *
+ * Sets up a bit reader over len bytes and fills its accumulator
+ */
+void Bitop_ReaderCreate(bit_reader_rec_t *b, const uint8_t *bytes, int len) {
+    b->p   = bytes;
+    b->end = bytes + (len > 0 ? len : 0);
+    b->acc = 0;
+    b->cnt = 0;
 
-    return result;
+    Bitop_Refill(b);
 }
 
 /*****************************************************************************/
 
-uint32_t Bitop_FetchNBits(bit_io_rec_t *b, const int n) {
-    uint32_t result = Bitop_PeekNBits(b, n);
-    Bitop_AdvanceNBits(b, n);
+/* Bitop_Refill_Tail()
+ *
+ * Refills the accumulator a byte at a time near
+ * the end of the data, padding with zero bytes
+ */
+void Bitop_Refill_Tail(bit_reader_rec_t *b) {
+    uint64_t byte;
 
-    return result;
+    while (b->cnt <= 56) {
+        byte = 0;
+        if (b->p < b->end)
+            byte = *b->p++;
+
+        b->acc |= byte << (56 - b->cnt);
+        b->cnt += 8;
+    }
 }
@@ -19,7 +19,9 @@
 
 /*****************************************************************************/
 
+#include <endian.h>
 #include <stdint.h>
+#include <string.h>
 
 /*****************************************************************************/
 
@@ -31,19 +33,69 @@ typedef struct bit_io_rec_t {
     int cur_len;
 } bit_io_rec_t;
 
-/*****************************************************************************/
-
-static inline void Bitop_AdvanceNBits(bit_io_rec_t *b, const int n) {
-    b->pos += n;
-}
+/* Bit reader data. Bits are read MSB first through a 64-bit
+ * accumulator, left aligned, that holds cnt valid bits */
+typedef struct bit_reader_rec_t {
+    const uint8_t *p, *end;
+    uint64_t acc;
+    int cnt;
+} bit_reader_rec_t;
 
 /*****************************************************************************/
 
 void Bitop_WriterCreate(bit_io_rec_t *w, uint8_t *bytes, int len);
 void Bitop_WriteBitlistReversed(bit_io_rec_t *w, uint8_t *l, int len);
 int Bitop_CountBits(uint32_t n);
-uint32_t Bitop_PeekNBits(bit_io_rec_t *b, const int n);
-uint32_t Bitop_FetchNBits(bit_io_rec_t *b, const int n);
+void Bitop_ReaderCreate(bit_reader_rec_t *b, const uint8_t *bytes, int len);
+void Bitop_Refill_Tail(bit_reader_rec_t *b);
+
+/*****************************************************************************/
+
+/* Bitop_Refill()
+ *
+ * Tops up the accumulator to at least 56 bits. Away from the end of
+ * the data this is one unaligned big-endian load, advancing by the
+ * whole bytes that fit. Past the end the data reads as zero bits
+ */
+static inline void Bitop_Refill(bit_reader_rec_t *b) {
+    uint64_t w;
+
+    if (b->end - b->p >= 8) {
+        memcpy(&w, b->p, 8);
+        b->acc |= be64toh(w) >> b->cnt;
+        b->p   += (63 - b->cnt) >> 3;
+        b->cnt |= 56;
+    }
+    else
+        Bitop_Refill_Tail(b);
+}
+
+/*****************************************************************************/
+
+/* Bitop_PeekNBits()
+ *
+ * Returns the next n (0-32) bits without consuming them.
+ * There must be at least n bits in the accumulator
+ */
+static inline uint32_t Bitop_PeekNBits(const bit_reader_rec_t *b, const int n) {
+    return (uint32_t)((b->acc >> 1) >> (63 - n));
+}
+
+/*****************************************************************************/
+
+static inline void Bitop_AdvanceNBits(bit_reader_rec_t *b, const int n) {
+    b->acc <<= n;
+    b->cnt  -= n;
+}
+
+/*****************************************************************************/
+
+static inline uint32_t Bitop_FetchNBits(bit_reader_rec_t *b, const int n) {
+    uint32_t result = Bitop_PeekNBits(b, n);
+    Bitop_AdvanceNBits(b, n);
+
+    return result;
+}
 
 /*****************************************************************************/
 
@@ -30,19 +30,36 @@
 
 /* Decoder correlator data */
 typedef struct corr_rec_t {
-    uint8_t patts[PATTERN_SIZE][PATTERN_SIZE];
+    /* Sync word in each IQ rotation/flip, MSB first */
+    uint64_t patts[PATTERN_CNT];
 
     int
         correlation[PATTERN_CNT],
-        tmp_corr[PATTERN_CNT],
         position[PATTERN_CNT];
 } corr_rec_t;
 
 /*****************************************************************************/
 
-int Hard_Correlate(const uint8_t d, const uint8_t w);
+/* Hard decision of a soft symbol: 1 for values <= 127 (non-negative) */
+static inline uint64_t Hard_Bit(const uint8_t d) {
+    return (uint64_t)(d <= 127);
+}
+
+/*****************************************************************************/
+
+/* Correlation between a soft symbol d and a hard value w (0 or 255) */
+static inline int Hard_Correlate(const uint8_t d, const uint8_t w) {
+    if (d > 127)
+        return (w == 0);
+    else
+        return (w == 255);
+}
+
+extern const uint8_t iq_hard_perm[PATTERN_CNT][4];
+
+/*****************************************************************************/
+
 void Init_Correlator_Tables(void);
-void Fix_Packet(void *data, int len, int shift);
 void Correlator_Init(corr_rec_t *c, uint64_t q);
 int Corr_Correlate(corr_rec_t *c, uint8_t *data, uint32_t len);
 
@@ -12,71 +12,203 @@
  *  http://www.gnu.org/copyleft/gpl.txt
  */
 
+
 /*****************************************************************************/
 
 #include "dct.h"
 
-#include <math.h>
-#include <stdbool.h>
 #include <stdint.h>
 
 /*****************************************************************************/
 
-static void Init_Cos(void);
+/* Fixed point precision of the constants and
+ * extra bits kept between the two passes */
+#define CONST_BITS  13
+#define PASS1_BITS  2
+
+/* Constants, scaled by 2^CONST_BITS */
+#define FIX_0_298631336     2446
+#define FIX_0_390180644     3196
+#define FIX_0_541196100     4433
+#define FIX_0_765366865     6270
+#define FIX_0_899976223     7373
+#define FIX_1_175875602     9633
+#define FIX_1_501321110     12299
+#define FIX_1_847759065     15137
+#define FIX_1_961570560     16069
+#define FIX_2_053119869     16819
+#define FIX_2_562915447     20995
+#define FIX_3_072711026     25172
+
+/* Right shift with rounding */
+#define DESCALE(x, n)   ( ((x) + (1 << ((n) - 1))) >> (n) )
 
 /*****************************************************************************/
 
-static double cosine[8][8];
-static double alpha[8];
+static inline uint8_t Clamp_Pixel(int64_t x);
 
 /*****************************************************************************/
 
-static void Init_Cos(void) {
-    static bool cos_inited = false;
-
-    if (cos_inited)
-        return;
-
-    cos_inited = true;
-
-    for (uint8_t y = 0; y < 8; y++)
-        for (uint8_t x = 0; x < 8; x++)
-            cosine[y][x] = cos(M_PI / 16.0 * (2.0 * (double)y + 1.0) * (double)x);
-
-    alpha[0] = 1.0 / sqrt(2.0);
-
-    for (uint8_t x = 1; x < 8; x++)
-        alpha[x] = 1.0;
+/* Clamp_Pixel()
+ *
+ * Clamps a level shifted sample to the pixel range
+ */
+static inline uint8_t Clamp_Pixel(int64_t x) {
+    if (x < 0)
+        return 0;
+    else if (x > 255)
+        return 255;
+    else
+        return (uint8_t)x;
 }
 
 /*****************************************************************************/
 
-void Flt_Idct_8x8(double *res, const double *inpt) {
-    Init_Cos();
-
-    for (uint8_t y = 0; y < 8; y++)
-        for (uint8_t x = 0; x < 8; x++) {
-            double s = 0;
-
-            /* for u = 0 to 7 do for v = 0 to 7 do
-             *s = s+inp[v*8+u]*alpha[u]*alpha[v]*cosine[x][u]*cosine[y][v];
-             */
-
-            for (uint8_t u = 0; u < 8; u++) {
-                double cxu = alpha[u] * cosine[x][u];
-
-                /* Unrolled to 8 */
-                s += cxu * (
-                        inpt[0 * 8 + u] * alpha[0] * cosine[y][0] +
-                        inpt[1 * 8 + u] * alpha[1] * cosine[y][1] +
-                        inpt[2 * 8 + u] * alpha[2] * cosine[y][2] +
-                        inpt[3 * 8 + u] * alpha[3] * cosine[y][3] +
-                        inpt[4 * 8 + u] * alpha[4] * cosine[y][4] +
-                        inpt[5 * 8 + u] * alpha[5] * cosine[y][5] +
-                        inpt[6 * 8 + u] * alpha[6] * cosine[y][6] +
-                        inpt[7 * 8 + u] * alpha[7] * cosine[y][7]);
-            }
-
-            res[y * 8 + x] = s / 4.0;
+/* Int_Idct_8x8()
+ *
+ * Separable integer inverse DCT of an 8x8 block after Loeffler,
+ * Ligtenberg and Moschytz (as in the IJG "islow" IDCT). Coefficients
+ * are in natural order and dequantized by dqt[] as they are read by
+ * the column pass. The result is level shifted and clamped to 0-255.
+ * The arithmetic is 64 bit, coefficients from corrupt packets are not
+ * bounded and would overflow 32 bit products and sums
+ */
+void Int_Idct_8x8(uint8_t *res, const int *coef, const int *dqt) {
+    int64_t ws[64];
+    int64_t tmp0, tmp1, tmp2, tmp3;
+    int64_t tmp10, tmp11, tmp12, tmp13;
+    int64_t z1, z2, z3, z4, z5;
+    const int64_t *w;
+
+    /* Pass 1: columns, into the work space scaled up by 2^PASS1_BITS */
+    for (int c = 0; c < 8; c++) {
+        const int *in = &coef[c];
+        const int *q  = &dqt[c];
+
+        /* Column with only a DC term, common in quantized blocks */
+        if ((in[8] | in[16] | in[24] | in[32] | in[40] | in[48] | in[56]) == 0) {
+            int64_t dc = (int64_t)in[0] * q[0] * (1 << PASS1_BITS);
+
+            for (int r = 0; r < 8; r++)
+                ws[r * 8 + c] = dc;
+            continue;
         }
+
+        /* Even part */
+        z2 = (int64_t)in[16] * q[16];
+        z3 = (int64_t)in[48] * q[48];
+
+        z1   = (z2 + z3) * FIX_0_541196100;
+        tmp2 = z1 - z3 * FIX_1_847759065;
+        tmp3 = z1 + z2 * FIX_0_765366865;
+
+        z2 = (int64_t)in[0]  * q[0];
+        z3 = (int64_t)in[32] * q[32];
+
+        tmp0 = (z2 + z3) * (1 << CONST_BITS);
+        tmp1 = (z2 - z3) * (1 << CONST_BITS);
+
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+
+        /* Odd part */
+        tmp0 = (int64_t)in[56] * q[56];
+        tmp1 = (int64_t)in[40] * q[40];
+        tmp2 = (int64_t)in[24] * q[24];
+        tmp3 = (int64_t)in[8]  * q[8];
+
+        z1 = tmp0 + tmp3;
+        z2 = tmp1 + tmp2;
+        z3 = tmp0 + tmp2;
+        z4 = tmp1 + tmp3;
+        z5 = (z3 + z4) * FIX_1_175875602;
+
+        tmp0 *= FIX_0_298631336;
+        tmp1 *= FIX_2_053119869;
+        tmp2 *= FIX_3_072711026;
+        tmp3 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223;
+        z2 *= -FIX_2_562915447;
+        z3 *= -FIX_1_961570560;
+        z4 *= -FIX_0_390180644;
+
+        z3 += z5;
+        z4 += z5;
+
+        tmp0 += z1 + z3;
+        tmp1 += z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        ws[0 * 8 + c] = DESCALE(tmp10 + tmp3, CONST_BITS - PASS1_BITS);
+        ws[7 * 8 + c] = DESCALE(tmp10 - tmp3, CONST_BITS - PASS1_BITS);
+        ws[1 * 8 + c] = DESCALE(tmp11 + tmp2, CONST_BITS - PASS1_BITS);
+        ws[6 * 8 + c] = DESCALE(tmp11 - tmp2, CONST_BITS - PASS1_BITS);
+        ws[2 * 8 + c] = DESCALE(tmp12 + tmp1, CONST_BITS - PASS1_BITS);
+        ws[5 * 8 + c] = DESCALE(tmp12 - tmp1, CONST_BITS - PASS1_BITS);
+        ws[3 * 8 + c] = DESCALE(tmp13 + tmp0, CONST_BITS - PASS1_BITS);
+        ws[4 * 8 + c] = DESCALE(tmp13 - tmp0, CONST_BITS - PASS1_BITS);
+    }
+
+    /* Pass 2: rows, removing the PASS1_BITS and the factor of 8 */
+    for (int r = 0; r < 8; r++) {
+        uint8_t *out = &res[r * 8];
+        w = &ws[r * 8];
+
+        /* Even part */
+        z2 = w[2];
+        z3 = w[6];
+
+        z1   = (z2 + z3) * FIX_0_541196100;
+        tmp2 = z1 - z3 * FIX_1_847759065;
+        tmp3 = z1 + z2 * FIX_0_765366865;
+
+        tmp0 = (w[0] + w[4]) * (1 << CONST_BITS);
+        tmp1 = (w[0] - w[4]) * (1 << CONST_BITS);
+
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+
+        /* Odd part */
+        tmp0 = w[7];
+        tmp1 = w[5];
+        tmp2 = w[3];
+        tmp3 = w[1];
+
+        z1 = tmp0 + tmp3;
+        z2 = tmp1 + tmp2;
+        z3 = tmp0 + tmp2;
+        z4 = tmp1 + tmp3;
+        z5 = (z3 + z4) * FIX_1_175875602;
+
+        tmp0 *= FIX_0_298631336;
+        tmp1 *= FIX_2_053119869;
+        tmp2 *= FIX_3_072711026;
+        tmp3 *= FIX_1_501321110;
+        z1 *= -FIX_0_899976223;
+        z2 *= -FIX_2_562915447;
+        z3 *= -FIX_1_961570560;
+        z4 *= -FIX_0_390180644;
+
+        z3 += z5;
+        z4 += z5;
+
+        tmp0 += z1 + z3;
+        tmp1 += z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        out[0] = Clamp_Pixel(128 + DESCALE(tmp10 + tmp3, CONST_BITS + PASS1_BITS + 3));
+        out[7] = Clamp_Pixel(128 + DESCALE(tmp10 - tmp3, CONST_BITS + PASS1_BITS + 3));
+        out[1] = Clamp_Pixel(128 + DESCALE(tmp11 + tmp2, CONST_BITS + PASS1_BITS + 3));
+        out[6] = Clamp_Pixel(128 + DESCALE(tmp11 - tmp2, CONST_BITS + PASS1_BITS + 3));
+        out[2] = Clamp_Pixel(128 + DESCALE(tmp12 + tmp1, CONST_BITS + PASS1_BITS + 3));
+        out[5] = Clamp_Pixel(128 + DESCALE(tmp12 - tmp1, CONST_BITS + PASS1_BITS + 3));
+        out[3] = Clamp_Pixel(128 + DESCALE(tmp13 + tmp0, CONST_BITS + PASS1_BITS + 3));
+        out[4] = Clamp_Pixel(128 + DESCALE(tmp13 - tmp0, CONST_BITS + PASS1_BITS + 3));
+    }
 }
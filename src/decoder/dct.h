@@ -19,7 +19,11 @@
 
 /*****************************************************************************/
 
-void Flt_Idct_8x8(double *res, const double *inpt);
+#include <stdint.h>
+
+/*****************************************************************************/
+
+void Int_Idct_8x8(uint8_t *res, const int *coef, const int *dqt);
 
 /*****************************************************************************/
 
@@ -93,34 +93,53 @@ static const uint8_t indx[256] = {
     246, 135, 165, 23, 58, 163, 60, 183
 };
 
+/* Antilog table repeated three times so that sums
+ * of up to three logarithms need no modulo 255 */
+static uint8_t exp_tab[3 * 255];
+
+/* Multiplication tables by the code generator roots,
+ * alpha^((112 + i) * 11), for syndrome computation */
+static uint8_t root_mul[32][256];
+
+/*****************************************************************************/
+
+/* Ecc_Init()
+ *
+ * Builds the extended antilog and per-root multiplication tables
+ */
+void Ecc_Init(void) {
+  int i, x, r;
+
+  for( i = 0; i < 3 * 255; i++ )
+    exp_tab[i] = alpha[ i % 255 ];
+
+  for( i = 0; i < 32; i++ )
+  {
+    r = ( (112 + i) * 11 ) % 255;
+    root_mul[i][0] = 0;
+    for( x = 1; x < 256; x++ )
+      root_mul[i][x] = exp_tab[ indx[x] + r ];
+  }
+}
+
 /*****************************************************************************/
 
-bool Ecc_Decode(uint8_t *idata, int pad) {
+/* Ecc_Correct()
+ *
+ * Corrects one (255,223) Reed-Solomon codeword in place, its
+ * symbols being stride bytes apart, given its (non-zero) syndromes.
+ * Returns false if the codeword is uncorrectable
+ */
+static bool Ecc_Correct(uint8_t *data, int stride, const uint8_t *syn) {
   int i, j, r, k, deg_lambda, el, deg_omega;
-  int syn_error;
+  int step, e, n;
   uint8_t q, tmp, num1, num2, den, discr_r;
   uint8_t lambda[33], b[33], reg[33], t[33], omega[33];
   uint8_t root[32], s[32], loc[32];
-  uint8_t *data;
   int result = 0; /* holds amount of errors fixed */
 
-  data = idata;
   for( i = 0; i < 32; i++ )
-    s[i] = data[0];
-  for( j = 1; j < 255 - pad; j++ )
-    for( i = 0; i < 32; i++ )
-      if( s[i] == 0 ) s[i] = data[j];
-      else s[i] = data[j] ^ alpha[ (indx[s[i]] + (112 + i) * 11) % 255 ];
-
-  syn_error = 0;
-  for( i = 0; i < 32; i++ )
-  {
-    syn_error |= s[i];
-    s[i] = indx[ s[i] ];
-  }
-
-  if (syn_error == 0)
-      return true;
+    s[i] = indx[ syn[i] ];
 
   bzero( &lambda[1], 32 );
   lambda[0] = 1;
@@ -135,7 +154,7 @@ bool Ecc_Decode(uint8_t *idata, int pad) {
     discr_r = 0;
     for( i = 0; i < r; i++ )
       if( (lambda[i] != 0) && (s[r - i - 1] != 255) )
-        discr_r ^= alpha[ (indx[lambda[i]] + s[r - i - 1]) % 255 ];
+        discr_r ^= exp_tab[ indx[lambda[i]] + s[r - i - 1] ];
 
     discr_r = indx[discr_r];
     if( discr_r == 255 )
@@ -149,7 +168,7 @@ bool Ecc_Decode(uint8_t *idata, int pad) {
       for( i = 0; i < 32; i++ )
       {
         if( b[i] != 255 )
-          t[i + 1] = lambda[i + 1] ^ alpha[ (discr_r + b[i]) % 255 ];
+          t[i + 1] = lambda[i + 1] ^ exp_tab[ discr_r + b[i] ];
         else
           t[i + 1] = lambda[i + 1];
       }
@@ -160,7 +179,12 @@ bool Ecc_Decode(uint8_t *idata, int pad) {
         for( i = 0; i < 32; i++ )
         {
           if( lambda[i] == 0 ) b[i] = 255;
-          else b[i] = (uint8_t)( (indx[lambda[i]] - discr_r + 255) % 255 );
+          else
+          {
+            e = indx[lambda[i]] - discr_r;
+            if( e < 0 ) e += 255;
+            b[i] = (uint8_t)e;
+          }
         }
       }
       else
@@ -183,6 +207,7 @@ bool Ecc_Decode(uint8_t *idata, int pad) {
   memmove( &reg[1], &lambda[1], 32 );
   result = 0;
 
+  /* Chien search for the roots of the error locator */
   i = 1;
   k = 115;
 
@@ -194,15 +219,18 @@ bool Ecc_Decode(uint8_t *idata, int pad) {
     {
       if( reg[j] != 255 )
       {
-        reg[j] = (uint8_t)( (reg[j] + j) % 255 );
-        q ^= alpha[ reg[j] ];
+        e = reg[j] + j;
+        if( e >= 255 ) e -= 255;
+        reg[j] = (uint8_t)e;
+        q ^= exp_tab[ e ];
       }
     }
 
     if( q != 0 )
     {
       i++;
-      k = (k + 116) % 255;
+      k += 116;
+      if( k >= 255 ) k -= 255;
       continue;
     }
 
@@ -213,7 +241,8 @@ bool Ecc_Decode(uint8_t *idata, int pad) {
       break;
 
     i++;
-    k = (k + 116) % 255;
+    k += 116;
+    if( k >= 255 ) k -= 255;
   }
 
   if (deg_lambda != result)
@@ -225,32 +254,44 @@ bool Ecc_Decode(uint8_t *idata, int pad) {
     tmp = 0;
     for( j = i; j >= 0; j-- )
       if( (s[i - j] != 255) && (lambda[j] != 255) )
-        tmp ^= alpha[ (s[i - j] + lambda[j]) % 255 ];
+        tmp ^= exp_tab[ s[i - j] + lambda[j] ];
     omega[i] = indx[tmp];
   }
 
+  /* Forney algorithm, powers of the roots kept reduced incrementally */
   for( j = result - 1; j >= 0; j-- )
   {
+    step = root[j] % 255;
+
     num1 = 0;
-    for( i = deg_omega; i >= 0; i-- )
+    e = 0;
+    for( i = 0; i <= deg_omega; i++ )
+    {
       if( omega[i] != 255 )
-        num1 ^= alpha[ (omega[i] + i * root[j]) % 255 ];
-    num2 = alpha[ (root[j] * 111 + 255) % 255 ];
-    den = 0;
+        num1 ^= exp_tab[ omega[i] + e ];
+      e += step;
+      if( e >= 255 ) e -= 255;
+    }
+    num2 = alpha[ (root[j] * 111) % 255 ];
 
     if( deg_lambda < 31 ) i = deg_lambda;
     else i = 31;
     i &= ~1;
 
-    while (true) {
-      if( !(i >= 0) ) break;
-      if( lambda[i + 1] != 255 )
-        den ^= alpha[ (lambda[i + 1] + i * root[j]) % 255 ];
-      i -= 2;
+    den = 0;
+    step += step;
+    if( step >= 255 ) step -= 255;
+    e = 0;
+    for( n = 0; n <= i; n += 2 )
+    {
+      if( lambda[n + 1] != 255 )
+        den ^= exp_tab[ lambda[n + 1] + e ];
+      e += step;
+      if( e >= 255 ) e -= 255;
     }
 
-    if( (num1 != 0) && (loc[j] >= pad) )
-      data[loc[j] - pad] ^= alpha[ (indx[num1] + indx[num2] + 255 - indx[den]) % 255 ];
+    if( num1 != 0 )
+      data[loc[j] * stride] ^= exp_tab[ indx[num1] + indx[num2] + 255 - indx[den] ];
   }
 
   return true;
@@ -258,16 +299,38 @@ bool Ecc_Decode(uint8_t *idata, int pad) {
 
 /*****************************************************************************/
 
-void Ecc_Deinterleave(uint8_t *data, uint8_t *output, int pos, int n) {
-  int i;
-  for( i = 0; i < 255; i++ )
-    output[i] = data[ i * n + pos ];
-}
+/* Ecc_Decode_Frame()
+ *
+ * Decodes the ECC_DEPTH Reed-Solomon codewords interleaved in data.
+ * Syndromes of all codewords are computed in a single pass over the
+ * frame and only codewords with errors are corrected, in place.
+ * result[] is set false for each codeword that is uncorrectable
+ */
+void Ecc_Decode_Frame(uint8_t *data, bool *result) {
+  uint8_t s[ECC_DEPTH][32];
+  const uint8_t *p;
+  int c, i, j, syn_error;
 
-/*****************************************************************************/
+  /* Syndromes by Horner's rule, one table lookup per root and symbol */
+  for( c = 0; c < ECC_DEPTH; c++ )
+    for( i = 0; i < 32; i++ )
+      s[c][i] = data[c];
 
-void Ecc_Interleave(uint8_t *data, uint8_t *output, int pos, int n) {
-  int i;
-  for( i = 0; i < 255; i++ )
-    output[ i * n + pos] = data[i];
+  p = &data[ECC_DEPTH];
+  for( j = 1; j < 255; j++, p += ECC_DEPTH )
+    for( c = 0; c < ECC_DEPTH; c++ )
+      for( i = 0; i < 32; i++ )
+        s[c][i] = p[c] ^ root_mul[i][ s[c][i] ];
+
+  for( c = 0; c < ECC_DEPTH; c++ )
+  {
+    syn_error = 0;
+    for( i = 0; i < 32; i++ )
+      syn_error |= s[c][i];
+
+    if( syn_error == 0 )
+      result[c] = true;
+    else
+      result[c] = Ecc_Correct( &data[c], ECC_DEPTH, s[c] );
+  }
 }
@@ -24,9 +24,13 @@
 
 /*****************************************************************************/
 
-bool Ecc_Decode(uint8_t *idata, int pad);
-void Ecc_Deinterleave(uint8_t *data, uint8_t *output, int pos, int n);
-void Ecc_Interleave(uint8_t *data, uint8_t *output, int pos, int n);
+/* Number of interleaved RS codewords in a frame */
+#define ECC_DEPTH   4
+
+/*****************************************************************************/
+
+void Ecc_Init(void);
+void Ecc_Decode_Frame(uint8_t *data, bool *result);
 
 /*****************************************************************************/
 
@@ -16,22 +16,42 @@
 
 #include "huffman.h"
 
-#include "../common/shared.h"
-#include "../glrpt/utils.h"
-
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
 
 /*****************************************************************************/
 
-static int Get_AC_Real(const uint16_t w);
 static int Get_DC_Real(const uint16_t w);
 
 /*****************************************************************************/
 
-static int ac_lookup[65536];
-static int dc_lookup[65536];
+/* Bits of the first level AC table index and
+ * maximum number of second level AC tables */
+#define AC_FAST_BITS    10
+#define AC_SUB_BITS     (16 - AC_FAST_BITS)
+#define AC_SUB_TABLES   8
+
+/* First level AC entries with this bit set hold
+ * the number of a second level table instead */
+#define AC_SUB_TABLE    0x8000
+
+/* Bits of the DC table index, the longest DC code */
+#define DC_FAST_BITS    9
+
+/*****************************************************************************/
+
+static uint16_t ac_fast[1 << AC_FAST_BITS];
+static uint16_t ac_sub[AC_SUB_TABLES][1 << AC_SUB_BITS];
+static uint8_t  dc_fast[1 << DC_FAST_BITS];
+
+/* DC code lengths by category */
+static const uint8_t dc_code_len[12] = {
+    2, 3, 3, 3, 3, 3, 4, 5, 6, 7, 8, 9
+};
 
 static uint8_t t_ac_0[178] = {
     0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4,
@@ -55,29 +75,29 @@ static uint8_t t_ac_0[178] = {
 
 /*****************************************************************************/
 
-int Get_AC(const uint16_t w) {
-  return( ac_lookup[w] );
-}
+/* Get_AC()
+ *
+ * Returns the packed AC table entry of the Huffman code
+ * at the top of w, or 0 if there is no such code
+ */
+uint16_t Get_AC(const uint16_t w) {
+  uint16_t e = ac_fast[ w >> AC_SUB_BITS ];
 
-/*****************************************************************************/
+  if( e & AC_SUB_TABLE )
+    e = ac_sub[ e & ~AC_SUB_TABLE ][ w & ((1 << AC_SUB_BITS) - 1) ];
 
-int Get_DC(const uint16_t w) {
-  return( dc_lookup[w] );
+  return( e );
 }
 
 /*****************************************************************************/
 
-static int Get_AC_Real(const uint16_t w) {
-  int i;
-
-  for( i = 0; (size_t)i < ac_table_len; i++ )
-  {
-    if( ((w >> (16 - ac_table[i].len)) &
-          ac_table[i].mask) == ac_table[i].code )
-      return( i );
-  }
-
-  return( -1 );
+/* Get_DC()
+ *
+ * Returns the packed DC table entry of the Huffman code
+ * at the top of w, or 0 if there is no such code
+ */
+uint8_t Get_DC(const uint16_t w) {
+  return( dc_fast[ w >> (16 - DC_FAST_BITS) ] );
 }
 
 /*****************************************************************************/
@@ -122,75 +142,73 @@ int Map_Range(const int cat, const int vl) {
 
 /*****************************************************************************/
 
+/* Default_Huffman_Table()
+ *
+ * Builds the AC and DC decoding tables. Canonical AC codes of up to
+ * AC_FAST_BITS bits fill all the first level entries they prefix,
+ * longer ones fill second level tables indexed by their low bits
+ */
 void Default_Huffman_Table(void) {
-  int k, i, n;
+  int k, i, j, p, sub, first, count;
   uint32_t code;
-  uint8_t *t;
-  int p;
-  uint8_t v[65536];
-  uint16_t min_code[17], maj_code[17];
-  uint16_t max_val, min_val, size_val;
-  int min_valn, max_valn, run, size;
+  uint16_t e, *tab;
+  const uint8_t *t;
 
+  bzero( ac_fast, sizeof(ac_fast) );
+  bzero( ac_sub,  sizeof(ac_sub) );
+
+  /* t[0..15] are the numbers of codes of each length, followed
+   * by the run/size values of the codes in canonical order */
   t = t_ac_0;
   p = 16;
-  for( k = 1; k <= 16; k++ )
-    for( i = 0; i < t[k - 1]; i++ )
-    {
-      v[(k << 8) + i] = t[p];
-      p++;
-    }
-
+  sub = 0;
   code = 0;
   for( k = 1; k <= 16; k++ )
   {
-    min_code[k] = (uint16_t)code;
-    for( i = 1; i <= t[k - 1]; i++ )
-      code++;
-    maj_code[k] = (uint16_t)( code - 1 * (uint32_t)(code != 0) );
-    code *= 2;
-    if( t[k - 1] == 0 )
+    for( i = 0; i < t[k - 1]; i++ )
     {
-      min_code[k] = 0xFFFF;
-      maj_code[k] = 0;
-    }
-  }
+      e = (uint16_t)( (k << 8) | t[p] );
 
-  ac_table_len = 256;
-  mem_alloc( (void **)&ac_table, ac_table_len * sizeof(ac_table_rec_t)) ;
-
-  n = 0;
-  min_valn = 1;
-  max_valn = 1;
-  for( k = 1; k <= 16; k++ )
-  {
-    min_val = min_code[min_valn];
-    max_val = maj_code[max_valn];
-    for( i = 0; i < (1 << k); i++ )
-    {
-      if( ((uint32_t)i <= max_val) &&
-          ((uint32_t)i >= min_val) )
+      if( k <= AC_FAST_BITS )
+      {
+        tab   = ac_fast;
+        first = (int)( code << (AC_FAST_BITS - k) );
+        count = 1 << (AC_FAST_BITS - k);
+      }
+      else
       {
-        size_val = v[(k << 8) + i - (int)min_val];
-        run = size_val >> 4;
-        size = size_val & 0x0F;
-        ac_table[n].run  = run;
-        ac_table[n].size = size;
-        ac_table[n].len  = k;
-        ac_table[n].mask = (1 << k) - 1;
-        ac_table[n].code = (uint32_t)i;
-        n++;
+        /* The standard table must fit in AC_SUB_TABLES, rather
+         * than have its long codes overwrite the first subtable */
+        j = (int)( code >> (k - AC_FAST_BITS) );
+        if( !(ac_fast[j] & AC_SUB_TABLE) )
+        {
+          if( sub >= AC_SUB_TABLES )
+          {
+            fprintf( stderr, "glrpt: %s\n",
+                "AC huffman table needs more than AC_SUB_TABLES subtables" );
+            exit( -1 );
+          }
+          ac_fast[j] = (uint16_t)( AC_SUB_TABLE | sub++ );
+        }
+
+        tab   = ac_sub[ ac_fast[j] & ~AC_SUB_TABLE ];
+        first = (int)( (code & ((1 << (k - AC_FAST_BITS)) - 1)) << (16 - k) );
+        count = 1 << (16 - k);
       }
+
+      for( j = 0; j < count; j++ )
+        tab[first + j] = e;
+
+      code++;
+      p++;
     }
-    min_valn++;
-    max_valn++;
+    code <<= 1;
   }
 
-  ac_table_len = (size_t)n;
-  mem_realloc( (void **)&ac_table, ac_table_len * sizeof(ac_table_rec_t) );
-
-  for( i = 0; i <= 65535; i++ )
-    ac_lookup[i] = Get_AC_Real((uint16_t)i);
-  for( i = 0; i <= 65535; i++ )
-    dc_lookup[i] = Get_DC_Real((uint16_t)i);
+  for( i = 0; i < (1 << DC_FAST_BITS); i++ )
+  {
+    k = Get_DC_Real( (uint16_t)(i << (16 - DC_FAST_BITS)) );
+    if( k < 0 ) dc_fast[i] = 0;
+    else dc_fast[i] = (uint8_t)( (dc_code_len[k] << 4) | k );
+  }
 }
@@ -23,16 +23,21 @@
 
 /*****************************************************************************/
 
-/* Decoder AC table data */
-typedef struct ac_table_rec_t {
-  int run, size, len;
-  uint32_t mask, code;
-} ac_table_rec_t;
+/* Packed AC table entries: size in bits 0-3,
+ * run in bits 4-7 and code length in bits 8-12 */
+#define AC_SIZE(e)  ( (e) & 0x0F )
+#define AC_RUN(e)   ( ((e) >> 4) & 0x0F )
+#define AC_LEN(e)   ( ((e) >> 8) & 0x1F )
+
+/* Packed DC table entries: category
+ * in bits 0-3 and code length in bits 4-7 */
+#define DC_CAT(e)   ( (e) & 0x0F )
+#define DC_LEN(e)   ( (e) >> 4 )
 
 /*****************************************************************************/
 
-int Get_AC(const uint16_t w);
-int Get_DC(const uint16_t w);
+uint16_t Get_AC(const uint16_t w);
+uint8_t Get_DC(const uint16_t w);
 int Map_Range(const int cat, const int vl);
 void Default_Huffman_Table(void);
 
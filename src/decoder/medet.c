@@ -21,6 +21,7 @@
 #include "../glrpt/display.h"
 #include "../glrpt/utils.h"
 #include "correlator.h"
+#include "ecc.h"
 #include "met_jpg.h"
 #include "met_packet.h"
 #include "met_to_data.h"
@@ -47,7 +48,9 @@ void Medet_Init(void) {
 
   /* Initialize things */
   Init_Correlator_Tables();
+  Ecc_Init();
   Mj_Init();
+  Mp_Init();
   Mtd_Init( &mtd_record );
 
   /* Channel_image[idx] is free'd and set to NULL if
@@ -55,6 +58,7 @@ void Medet_Init(void) {
   for( idx = 0; idx < CHANNEL_IMAGE_NUM; idx++ )
     free_ptr( (void **)&channel_image[idx] );
   channel_image_size = 0;
+  channel_image_height = 0;
   channel_image_width = METEOR_IMAGE_WIDTH;
 
   ok_cnt    = 0;
@@ -69,7 +73,6 @@ void Medet_Init(void) {
  */
 void Medet_Deinit(void) {
   free_ptr( (void **)&(mtd_record.v.pair_distances) );
-  free_ptr( (void **)&ac_table );
   uint8_t **dec = ret_decoded();
   free_ptr( (void **)dec );
 }
@@ -80,15 +83,30 @@ void Medet_Deinit(void) {
  *
  * Decodes images from soft symbols supplied by the demodulator
  */
-void Decode_Image(uint8_t *in_buffer, int buf_len) {
+void Decode_Image(Soft_Ring_t *ring) {
   bool ok;
   gchar txt[16];
+  int64_t limit;
 
-  while( mtd_record.pos < buf_len )
+  /* Frames may be searched for up to a frame past where they
+   * start, so decoding stops two frames short of the ring head */
+  limit = ring->write_pos - 2 * SOFT_FRAME_LEN;
+
+  /* Skip soft symbols that went by while not decoding, or
+   * start over if the ring was created anew by a restart */
+  if( (mtd_record.pos < limit - SOFT_FRAME_LEN) ||
+      (mtd_record.pos > ring->write_pos) )
+  {
+    mtd_record.pos = limit - SOFT_FRAME_LEN;
+    if( mtd_record.pos < 0 ) mtd_record.pos = 0;
+  }
+
+  while( mtd_record.pos < limit )
   {
-    ok = Mtd_One_Frame( &mtd_record, in_buffer );
+    ok = Mtd_One_Frame( &mtd_record, ring );
     if (ok) {
       Parse_Cvcdu( mtd_record.ecced_data, HARD_FRAME_LEN - 132 );
+      Mp_Dispatch_Packets();
       ok_cnt++;
 
       if( isFlagClear(FRAME_OK_ICON) )
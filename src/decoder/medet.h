@@ -19,13 +19,15 @@
 
 /*****************************************************************************/
 
+#include "../demodulator/soft_ring.h"
+
 #include <stdint.h>
 
 /*****************************************************************************/
 
 void Medet_Init(void);
 void Medet_Deinit(void);
-void Decode_Image(uint8_t *in_buffer, int buf_len);
+void Decode_Image(Soft_Ring_t *ring);
 double Sig_Quality(void);
 
 /*****************************************************************************/
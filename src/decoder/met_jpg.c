@@ -18,6 +18,7 @@
 
 #include "../common/common.h"
 #include "../common/shared.h"
+#include "../common/thread_pool.h"
 #include "../glrpt/clahe.h"
 #include "../glrpt/image.h"
 #include "../glrpt/jpeg.h"
@@ -28,14 +29,23 @@
 #include "rectify_meteor.h"
 
 #include <math.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 /*****************************************************************************/
 
 #define MCU_PER_PACKET  14
 
+/* Image rows reserved by the first allocation of the APID planes */
+#define IMAGE_RESERVE_ROWS  512
+
+/* APIDs of the MSU-MR channels, each decoded into a plane of its own */
+#define APID_FIRST      64
+#define APID_PLANE_NUM  6
+
 /*****************************************************************************/
 
 enum {
@@ -43,12 +53,44 @@ enum {
     COLORIZED_CHAN = 3
 };
 
+/* States of the rectification of images during reception */
+enum {
+    INC_IDLE = 0,   /* Not started yet in this pass    */
+    INC_ON,         /* Rectifying lines as they finish */
+    INC_OFF         /* Off, or handed over at the end  */
+};
+
+/* Lines of a channel image queued for rectification by a worker */
+typedef struct inc_job_t {
+    const uint8_t *in;  /* First unrectified line, NULL if all black */
+    uint8_t  *out;      /* First rectified line                      */
+    uint32_t  lines;
+    uint32_t *hist;     /* Histogram of the rectified channel image  */
+} inc_job_t;
+
+/* A packet of MCUs queued for decoding by a worker thread */
+typedef struct mcu_job_t {
+    uint8_t *dst;       /* APID plane row of the packet's MCUs     */
+    uint64_t inv;       /* Palette inversion mask of the APID      */
+    int      mcu_id;    /* MCU id of the first block of the packet */
+    int      len;
+    uint8_t  q;
+    uint8_t  data[];    /* Copy of the packet's MCU bytes          */
+} mcu_job_t;
+
 /*****************************************************************************/
 
 static void Save_Images(int type);
 static void Fill_Dqt_by_Q(int *dqt, int q);
-static void Fill_Pix(double *img_dct, uint32_t apid, int mcu_id, int m);
+static int Apid_Plane(uint32_t apid);
+static void Selected_Planes(uint8_t *planes[]);
+static void Fill_Pix(uint8_t *dst, const uint8_t *pix, uint64_t inv);
 static bool Progress_Image(uint32_t apid, int mcu_id, int pck_cnt);
+static void Dec_Mcus_Job(void *arg);
+static void Report_Errors(void);
+static void Rectify_Job(void *arg);
+static void Rectify_Done_Lines(int limit);
+static bool Finish_Rectify(uint32_t hist[][MAX_WHITE+1]);
 
 /*****************************************************************************/
 
@@ -58,6 +100,31 @@ static int last_y    = -1;
 static int first_pck = 0;
 static int prev_pck  = 0;
 
+/* Images of all the MSU-MR APIDs, allocated with their first packet.
+ * They share the capacity reserved for them, in pixels */
+static uint8_t *apid_plane[APID_PLANE_NUM];
+static size_t   plane_cap = 0;
+
+/* Selected channel images rectified while the pass is received,
+ * with their histograms. Lines are rectified a row of MCUs behind
+ * the one being decoded, in case of late packets, and mirrored if
+ * the images are to be flipped, so that only the order of lines
+ * needs reversing at the end */
+static uint8_t *inc_image[CHANNEL_IMAGE_NUM];
+static uint32_t inc_hist[CHANNEL_IMAGE_NUM][MAX_WHITE+1];
+static inc_job_t inc_job[CHANNEL_IMAGE_NUM];
+static uint32_t
+  inc_lines = 0,    /* Lines rectified so far         */
+  inc_cap   = 0,    /* Lines allocated                */
+  inc_width = 0;    /* Width of the rectified images  */
+static int     inc_state    = INC_IDLE;
+static bool    inc_flip     = false;
+static uint8_t inc_function = 0;
+
+/* Bad huffman codes met by the workers, reported by the main thread */
+static atomic_int bad_dc_cnt = 0;
+static atomic_int bad_ac_cnt = 0;
+
 static const uint8_t standard_quantization_table[64] = {
     16,  11,  10,  16,  24,  40,  51,  61,
     12,  12,  14,  19,  26,  58,  60,  55,
@@ -80,8 +147,6 @@ static const uint8_t zigzag[64] = {
     35, 36, 48, 49, 57, 58, 62, 63
 };
 
-static const int dc_cat_off[12] = { 2, 3, 3, 3, 3, 3, 4, 5, 6, 7, 8, 9 };
-
 /*****************************************************************************/
 
 /* Save_Images()
@@ -193,48 +258,66 @@ static void Save_Images(int type) {
 void Mj_Dump_Image(void) {
   uint32_t idx;
 
+  /* Let the workers finish the queued packets */
+  Mj_Sync();
+
   /* Abort if no images successfully decoded */
   if (channel_image_size == 0)
     return;
 
   /* My addition, process images when reception finished */
   if (isFlagClear(STATUS_RECEIVING)) {
+    /* Compose the channel images from the APID planes */
+    if (isFlagClear(IMAGES_PROCESSED))
+        Mj_Compose_Channels();
+
     /* Save images in Raw state first, if enabled */
     if (isFlagSet(IMAGE_RAW))
         Save_Images(IMAGE_RAW);
 
     /* Process images if not already done */
     if (isFlagClear(IMAGES_PROCESSED)) {
-      /* My addition, invert image (flip vertically) */
-      if (isFlagSet(IMAGE_INVERT)) {
+      /* Histograms of the images, if built on the way */
+      uint32_t hist[CHANNEL_IMAGE_NUM][MAX_WHITE+1];
+      bool have_hist = false, flip;
+
+      /* Rectify (stretch) images to correct scan distortion, and
+       * invert them (flip vertically) in the same pass if enabled.
+       * Most lines are normally rectified already during reception */
+      if (isFlagSet(IMAGE_RECTIFY) && isFlagClear(IMAGES_RECTIFIED)) {
+        have_hist = Finish_Rectify(hist);
+        if (!have_hist)
+          have_hist = Rectify_Images(isFlagSet(IMAGE_INVERT), hist);
+      }
+
+      /* My addition, invert image (flip vertically), in the
+       * normalization pass if the images are not rectified */
+      flip = isFlagSet(IMAGE_INVERT) && !have_hist;
+      if (flip && isFlagClear(IMAGE_NORMALIZE)) {
         for (idx = 0; idx < CHANNEL_IMAGE_NUM; idx++)
           Flip_Image(channel_image[idx], (uint32_t)channel_image_size);
       }
 
-      /* Rectify (stretch) images to correct scan distortion */
-      if (isFlagSet(IMAGE_RECTIFY) && isFlagClear(IMAGES_RECTIFIED))
-        Rectify_Images();
-
       /* Normalize images if enabled */
       if (isFlagSet(IMAGE_NORMALIZE)) {
-        for (idx = 0; idx < CHANNEL_IMAGE_NUM; idx++) {
-          /* Normalize (Equalize) histogram to cover full pixel value range */
-          Normalize_Image(channel_image[idx],
-              (uint32_t)channel_image_size, NORM_BLACK, MAX_WHITE);
-
-          /* C.L.A.H.E. Normalization, see ../glrpt/clahe.c */
-          if (isFlagSet(IMAGE_CLAHE)) {
+        /* Normalize (Equalize) histogram to cover full pixel value range */
+        Normalize_Images(channel_image, CHANNEL_IMAGE_NUM,
+            (uint32_t)channel_image_size, NORM_BLACK, MAX_WHITE,
+            have_hist ? hist : NULL, flip);
+
+        /* C.L.A.H.E. Normalization, see ../glrpt/clahe.c,
+         * each channel image split over the workers */
+        if (isFlagSet(IMAGE_CLAHE)) {
+          for (idx = 0; idx < CHANNEL_IMAGE_NUM; idx++)
             if (!CLAHE(channel_image[idx],
                   channel_image_width,
                   channel_image_height,
                   NORM_BLACK, MAX_WHITE,
                   REGIONS_X, REGIONS_Y,
-                  NUM_GREYBINS, CLIP_LIMIT)) {
+                  NUM_GREYBINS, CLIP_LIMIT))
               Show_Message(
                   "Failed to perform C.L.A.H.E.\n"\
                     "Image Contrast Enhancement", "red");
-            }
-          }
         }
       }
 
@@ -277,48 +360,198 @@ static void Fill_Dqt_by_Q(int *dqt, int q) {
 
 /*****************************************************************************/
 
-static void Fill_Pix(double *img_dct, uint32_t apid, int mcu_id, int m) {
-  int i, j, t, x, y, off = 0, inv = 0;
+/* Apid_Plane()
+ *
+ * Returns the index of the plane that an APID is decoded into, or -1
+ */
+static int Apid_Plane(uint32_t apid) {
+  if( (apid < APID_FIRST) || (apid >= APID_FIRST + APID_PLANE_NUM) )
+    return( -1 );
+
+  return( (int)(apid - APID_FIRST) );
+}
 
-  for( i = 0; i <= 63; i++ )
+/*****************************************************************************/
+
+/* Selected_Planes()
+ *
+ * Fills planes[] with the APID planes selected for the channel
+ * images, NULL where an APID has no plane or no packets yet
+ */
+static void Selected_Planes(uint8_t *planes[]) {
+  int i, idx;
+
+  for( i = 0; i < CHANNEL_IMAGE_NUM; i++ )
   {
-    t = (int)( round(img_dct[i] + 128.0) );
-    if( t < 0 )   t = 0;
-    if( t > 255 ) t = 255;
-    x = ( mcu_id + m ) * 8 + i % 8;
-    y = cur_y + i / 8;
-    off = x + y * METEOR_IMAGE_WIDTH;
-
-    /* Invert image palette if APID matches */
-    for( j = 0; j < 3; j++ )
-      if( apid == rc_data.invert_palette[j] ) inv = 1;
-    if( inv )
-    {
-      if( apid == rc_data.apid[RED] )
-        channel_image[RED][off]   = 255 - (uint8_t)t;
-      else if( apid == rc_data.apid[GREEN] )
-        channel_image[GREEN][off] = 255 - (uint8_t)t;
-      else if( apid == rc_data.apid[BLUE] )
-        channel_image[BLUE][off]  = 255 - (uint8_t)t;
-    }
-    else /* Normal palette */
-    {
-      if( apid == rc_data.apid[RED] )
-        channel_image[RED][off]   = (uint8_t)t;
-      else if( apid == rc_data.apid[GREEN] )
-        channel_image[GREEN][off] = (uint8_t)t;
-      else if( apid == rc_data.apid[BLUE] )
-        channel_image[BLUE][off]  = (uint8_t)t;
-    }
+    idx = Apid_Plane( rc_data.apid[i] );
+    planes[i] = ( idx < 0 ) ? NULL : apid_plane[idx];
+  }
+}
+
+/*****************************************************************************/
+
+/* Fill_Pix()
+ *
+ * Copies an 8x8 block of pixels into an APID plane,
+ * a row at a time, XORing them with the inversion mask
+ */
+static void Fill_Pix(uint8_t *dst, const uint8_t *pix, uint64_t inv) {
+  uint64_t row;
+  int i;
+
+  for( i = 0; i < 8; i++ )
+  {
+    memcpy( &row, &pix[i * 8], 8 );
+    row ^= inv;
+    memcpy( &dst[i * METEOR_IMAGE_WIDTH], &row, 8 );
   }
 }
 
 /*****************************************************************************/
 
+/* Rectify_Job()
+ *
+ * Worker thread job, rectifies lines of a channel image
+ */
+static void Rectify_Job(void *arg) {
+  inc_job_t *job = (inc_job_t *)arg;
+  size_t len = (size_t)job->lines * inc_width;
+
+  if( job->in != NULL )
+    Rectify_Lines( job->in, job->out, job->lines, inc_flip, job->hist );
+  else
+  {
+    memset( job->out, 0, len );
+    job->hist[0] += (uint32_t)len;
+  }
+}
+
+/*****************************************************************************/
+
+/* Rectify_Done_Lines()
+ *
+ * Queues the lines of the selected channel images above limit, that
+ * are not rectified yet, for rectification. Called with no jobs
+ * running, as the rectified images may need to grow
+ */
+static void Rectify_Done_Lines(int limit) {
+  uint8_t *planes[CHANNEL_IMAGE_NUM];
+  uint32_t new_cap;
+  int i;
+
+  /* Rectifying settings are taken at the start of the pass */
+  if( inc_state == INC_IDLE )
+  {
+    inc_width = isFlagSet(IMAGE_RECTIFY) ? Rectify_Prepare( false ) : 0;
+    inc_state = ( inc_width > 0 ) ? INC_ON : INC_OFF;
+    inc_flip  = isFlagSet( IMAGE_INVERT );
+    inc_function = rc_data.rectify_function;
+  }
+
+  if( (inc_state != INC_ON) || (limit <= (int)inc_lines) )
+    return;
+
+  if( (uint32_t)limit > inc_cap )
+  {
+    new_cap = 2 * inc_cap;
+    if( new_cap < IMAGE_RESERVE_ROWS ) new_cap = IMAGE_RESERVE_ROWS;
+    if( new_cap < (uint32_t)limit ) new_cap = (uint32_t)limit;
+    for( i = 0; i < CHANNEL_IMAGE_NUM; i++ )
+      mem_realloc( (void **)&inc_image[i], (size_t)new_cap * inc_width );
+    inc_cap = new_cap;
+  }
+
+  Selected_Planes( planes );
+  for( i = 0; i < CHANNEL_IMAGE_NUM; i++ )
+  {
+    inc_job[i].in = ( planes[i] == NULL ) ? NULL :
+      planes[i] + (size_t)inc_lines * METEOR_IMAGE_WIDTH;
+    inc_job[i].out   = inc_image[i] + (size_t)inc_lines * inc_width;
+    inc_job[i].lines = (uint32_t)limit - inc_lines;
+    inc_job[i].hist  = inc_hist[i];
+    Pool_Submit( thread_pool, Rectify_Job, &inc_job[i] );
+  }
+  inc_lines = (uint32_t)limit;
+}
+
+/*****************************************************************************/
+
+/* Finish_Rectify()
+ *
+ * Rectifies the last lines of the channel images that were rectified
+ * during reception, reverses their lines if flipped and hands them
+ * over as the channel images, storing their histograms in hist.
+ * Returns false if they can't be used, as the settings have changed
+ */
+static bool Finish_Rectify(uint32_t hist[][MAX_WHITE+1]) {
+  uint8_t *temp = NULL;
+  uint32_t line, lines;
+  size_t len;
+  int i;
+
+  Mj_Sync();
+  if( (inc_state != INC_ON) ||
+      (inc_flip != (bool)isFlagSet(IMAGE_INVERT)) ||
+      (inc_function != rc_data.rectify_function) ||
+      (inc_lines > channel_image_height) ||
+      (Rectify_Prepare(true) != inc_width) )
+    return( false );
+
+  if( inc_flip )
+    Show_Message( "Rotating Image by 180 degrees", "black" );
+
+  /* Rectify the lines left and make them the channel images */
+  lines = channel_image_height - inc_lines;
+  len   = (size_t)inc_width * channel_image_height;
+  mem_alloc( (void **)&temp, inc_width );
+  for( i = 0; i < CHANNEL_IMAGE_NUM; i++ )
+  {
+    mem_realloc( (void **)&inc_image[i], len );
+    Rectify_Lines(
+        channel_image[i] + (size_t)inc_lines * METEOR_IMAGE_WIDTH,
+        inc_image[i] + (size_t)inc_lines * inc_width,
+        lines, inc_flip, inc_hist[i] );
+
+    /* The lines are mirrored already, so reverse their order */
+    if( inc_flip )
+      for( line = 0; line < channel_image_height / 2; line++ )
+      {
+        uint8_t *top = inc_image[i] + (size_t)line * inc_width;
+        uint8_t *bot = inc_image[i] +
+          (size_t)(channel_image_height - 1 - line) * inc_width;
+        memcpy( temp, top, inc_width );
+        memcpy( top, bot, inc_width );
+        memcpy( bot, temp, inc_width );
+      }
+
+    free_ptr( (void **)&channel_image[i] );
+    channel_image[i] = inc_image[i];
+    inc_image[i] = NULL;
+    memcpy( hist[i], inc_hist[i], sizeof(inc_hist[i]) );
+  }
+  free_ptr( (void **)&temp );
+
+  channel_image_width = inc_width;
+  channel_image_size  = len;
+  inc_state = INC_OFF;
+  inc_lines = 0;
+  inc_cap   = 0;
+  SetFlag( IMAGES_RECTIFIED );
+
+  return( true );
+}
+
+/*****************************************************************************/
+
+/* Progress_Image()
+ *
+ * Finds the image row of a packet from its count and grows the
+ * APID planes to hold it. Their storage is reserved in doubling
+ * steps, so that growing them by a row is amortized O(1)
+ */
 static bool Progress_Image(uint32_t apid, int mcu_id, int pck_cnt) {
-  static size_t prev_len = 0;
-  size_t delta_len = 0, i, s;
-  int j;
+  size_t new_cap;
+  int i;
 
   if( (apid == 0) || (apid == 70) )
     return false;
@@ -334,7 +567,6 @@ static bool Progress_Image(uint32_t apid, int mcu_id, int pck_cnt) {
       first_pck -= 28;
     last_mcu = 0;
     cur_y = -1;
-    prev_len = 0;
   }
 
   if( pck_cnt < prev_pck ) first_pck -= 16384;
@@ -343,22 +575,36 @@ static bool Progress_Image(uint32_t apid, int mcu_id, int pck_cnt) {
   cur_y = 8 * ( (pck_cnt - first_pck) / 43 );
   if( cur_y > last_y )
   {
-    channel_image_height = (uint32_t)( cur_y + 8 );
-    channel_image_size = (size_t)
-      ( channel_image_width * channel_image_height );
-    for( i = 0; i < CHANNEL_IMAGE_NUM; i++ )
-      mem_realloc( (void **)&channel_image[i], channel_image_size );
+    /* Finish the rows above before they are displayed or moved */
+    Pool_Wait( thread_pool );
+
+    if( (uint32_t)(cur_y + 8) > channel_image_height )
+    {
+      channel_image_height = (uint32_t)( cur_y + 8 );
+      channel_image_size = (size_t)
+        ( channel_image_width * channel_image_height );
+    }
 
-    /* Clear new allocation */
-    delta_len = channel_image_size - prev_len;
-    for( i = 0; i < delta_len; i++ )
+    if( channel_image_size > plane_cap )
     {
-      s = i + prev_len;
-      for( j = 0; j < CHANNEL_IMAGE_NUM; j++ )
-        channel_image[j][s] = 0;
+      new_cap = 2 * plane_cap;
+      if( new_cap < IMAGE_RESERVE_ROWS * METEOR_IMAGE_WIDTH )
+        new_cap = IMAGE_RESERVE_ROWS * METEOR_IMAGE_WIDTH;
+      if( new_cap < channel_image_size )
+        new_cap = channel_image_size;
+
+      /* Clear the new reservation in bulk */
+      for( i = 0; i < APID_PLANE_NUM; i++ )
+      {
+        if( apid_plane[i] == NULL ) continue;
+        mem_realloc( (void **)&apid_plane[i], new_cap );
+        memset( apid_plane[i] + plane_cap, 0, new_cap - plane_cap );
+      }
+      plane_cap = new_cap;
     }
 
-    prev_len = channel_image_size;
+    /* Rectify the lines finished a row of MCUs ago */
+    Rectify_Done_Lines( cur_y - 8 );
   }
   last_y = cur_y;
 
@@ -367,42 +613,46 @@ static bool Progress_Image(uint32_t apid, int mcu_id, int pck_cnt) {
 
 /*****************************************************************************/
 
-void Mj_Dec_Mcus(
-        uint8_t *p,
-        uint32_t apid,
-        int pck_cnt,
-        int mcu_id,
-        uint8_t q) {
-  bit_io_rec_t b;
+/* Dec_Mcus_Job()
+ *
+ * Worker thread job, decodes the MCUs of a packet into its APID plane
+ * row. The DC prediction starts over in each packet, so all
+ * the packets of a row can be decoded independently of each other
+ */
+static void Dec_Mcus_Job(void *arg) {
+  mcu_job_t *job = (mcu_job_t *)arg;
+  bit_reader_rec_t b;
   int i, m;
   uint16_t k, n;
-  double prev_dc;
-  int dc_cat, ac;
-  double dct[64];
-  double zdct[64];
-  double img_dct[64];
+  int prev_dc;
+  int dc_cat;
+  uint16_t ac;
+  uint8_t dc;
+  int dct[64];
+  int zdct[64];
+  uint8_t pix[64];
   int dqt[64];
   int ac_run, ac_size, ac_len;
 
-  b.p = p;
-  b.pos = 0;
+  Bitop_ReaderCreate( &b, job->data, job->len );
 
-  if( !Progress_Image(apid, mcu_id, pck_cnt) )
-    return;
-
-  Fill_Dqt_by_Q( dqt, q );
+  Fill_Dqt_by_Q( dqt, job->q );
 
   prev_dc = 0;
   m = 0;
   while( m < MCU_PER_PACKET )
   {
-    dc_cat = Get_DC( (uint16_t)(Bitop_PeekNBits(&b, 16)) );
-    if( dc_cat == -1 )
+    /* A DC or AC symbol with its value takes at most 27 bits */
+    Bitop_Refill( &b );
+    dc = Get_DC( (uint16_t)(Bitop_PeekNBits(&b, 16)) );
+    if( dc == 0 )
     {
-      Show_Message( "Bad DC huffman code!", "red" );
+      atomic_fetch_add( &bad_dc_cnt, 1 );
+      free_ptr( (void **)&job );
       return;
     }
-    Bitop_AdvanceNBits( &b, dc_cat_off[dc_cat] );
+    dc_cat = DC_CAT( dc );
+    Bitop_AdvanceNBits( &b, DC_LEN(dc) );
     n = (uint16_t)(Bitop_FetchNBits( &b, dc_cat ));
 
     zdct[0] = Map_Range( dc_cat, n ) + prev_dc;
@@ -411,15 +661,17 @@ void Mj_Dec_Mcus(
     k = 1;
     while( k < 64 )
     {
+      Bitop_Refill( &b );
       ac = Get_AC( (uint16_t)(Bitop_PeekNBits(&b, 16)) );
-      if( ac == -1 )
+      if( ac == 0 )
       {
-        Show_Message( "Bad DC huffman code!", "red" );
+        atomic_fetch_add( &bad_ac_cnt, 1 );
+        free_ptr( (void **)&job );
         return;
       }
-      ac_len  = ac_table[ac].len;
-      ac_size = ac_table[ac].size;
-      ac_run  = ac_table[ac].run;
+      ac_len  = AC_LEN( ac );
+      ac_size = AC_SIZE( ac );
+      ac_run  = AC_RUN( ac );
       Bitop_AdvanceNBits(&b, ac_len);
 
       if( (ac_run == 0) && (ac_size == 0) )
@@ -428,6 +680,14 @@ void Mj_Dec_Mcus(
         break;
       }
 
+      /* A run, with its value or the ZRL zero, must stay in the block */
+      if( k + ac_run + ((ac_size != 0) || (ac_run == 15)) > 64 )
+      {
+        atomic_fetch_add( &bad_ac_cnt, 1 );
+        free_ptr( (void **)&job );
+        return;
+      }
+
       for( i = 0; i < ac_run; i++ )
       {
         zdct[k] = 0;
@@ -448,20 +708,139 @@ void Mj_Dec_Mcus(
     }
 
     for( i = 0; i <= 63; i++ )
-      dct[i] = zdct[ zigzag[i] ] * dqt[i];
+      dct[i] = zdct[ zigzag[i] ];
+
+    /* Blocks past the image width can only come from a bad packet */
+    if( (job->mcu_id + m + 1) * 8 > METEOR_IMAGE_WIDTH )
+      break;
 
-    Flt_Idct_8x8( img_dct, dct );
-    Fill_Pix( img_dct, apid, mcu_id, m );
+    Int_Idct_8x8( pix, dct, dqt );
+    Fill_Pix( &job->dst[(job->mcu_id + m) * 8], pix, job->inv );
     m++;
   }
 
+  free_ptr( (void **)&job );
+}
+
+/*****************************************************************************/
+
+/* Report_Errors()
+ *
+ * Shows the bad huffman codes met by the workers since the last call
+ */
+static void Report_Errors(void) {
+  if( atomic_exchange(&bad_dc_cnt, 0) > 0 )
+    Show_Message( "Bad DC huffman code!", "red" );
+  if( atomic_exchange(&bad_ac_cnt, 0) > 0 )
+    Show_Message( "Bad AC huffman code!", "red" );
+}
+
+/*****************************************************************************/
+
+/* Mj_Dec_Mcus()
+ *
+ * Places a packet of MCUs in its APID plane and queues it
+ * for decoding by the worker threads. Only the rows above the
+ * packet's one are complete, and only those are displayed
+ */
+void Mj_Dec_Mcus(
+        uint8_t *p,
+        int len,
+        uint32_t apid,
+        int pck_cnt,
+        int mcu_id,
+        uint8_t q) {
+  mcu_job_t *job = NULL;
+  uint8_t *planes[CHANNEL_IMAGE_NUM];
+  int i, idx;
+  uint64_t inv;
+
+  Report_Errors();
+
+  if( !Progress_Image(apid, mcu_id, pck_cnt) )
+    return;
+
+  /* Resolve the destination plane and palette once per packet */
+  idx = Apid_Plane( apid );
+  if( (idx < 0) || (len <= 0) )
+    return;
+
+  if( apid_plane[idx] == NULL )
+    mem_alloc( (void **)&apid_plane[idx], plane_cap );
+
+  inv = 0;
+  for( i = 0; i < 3; i++ )
+    if( apid == rc_data.invert_palette[i] ) inv = ~(uint64_t)0;
+
+  /* The packet buffer is reused for the next frame, so copy it */
+  mem_alloc( (void **)&job, sizeof(mcu_job_t) + (size_t)len );
+  job->dst    = apid_plane[idx] + (size_t)cur_y * METEOR_IMAGE_WIDTH;
+  job->inv    = inv;
+  job->mcu_id = mcu_id;
+  job->len    = len;
+  job->q      = q;
+  memcpy( job->data, p, (size_t)len );
+  Pool_Submit( thread_pool, Dec_Mcus_Job, job );
+
   /* My addition, incrementally display LRPT images */
-  Display_Scaled_Image( channel_image, apid, cur_y );
+  Selected_Planes( planes );
+  Display_Scaled_Image( planes, apid, cur_y );
+}
+
+/*****************************************************************************/
+
+/* Mj_Compose_Channels()
+ *
+ * Copies the APID planes selected in rc_data.apid[] into the
+ * channel images, which are left black for APIDs not received
+ */
+void Mj_Compose_Channels(void) {
+  uint8_t *planes[CHANNEL_IMAGE_NUM];
+  int i;
+
+  Mj_Sync();
+  Selected_Planes( planes );
+
+  for( i = 0; i < CHANNEL_IMAGE_NUM; i++ )
+  {
+    mem_realloc( (void **)&channel_image[i], channel_image_size );
+    if( planes[i] != NULL )
+      memcpy( channel_image[i], planes[i], channel_image_size );
+    else
+      memset( channel_image[i], 0, channel_image_size );
+  }
+}
+
+/*****************************************************************************/
+
+/* Mj_Sync()
+ *
+ * Waits for the queued packets to be decoded into the APID planes
+ */
+void Mj_Sync(void) {
+  Pool_Wait( thread_pool );
+  Report_Errors();
 }
 
 /*****************************************************************************/
 
 void Mj_Init(void) {
+  int i;
+
+  /* Channel images are freed and reallocated after this */
+  Mj_Sync();
+
+  for( i = 0; i < APID_PLANE_NUM; i++ )
+    free_ptr( (void **)&apid_plane[i] );
+  plane_cap = 0;
+
+  for( i = 0; i < CHANNEL_IMAGE_NUM; i++ )
+    free_ptr( (void **)&inc_image[i] );
+  memset( inc_hist, 0, sizeof(inc_hist) );
+  inc_lines = 0;
+  inc_cap   = 0;
+  inc_state = INC_IDLE;
+
   Default_Huffman_Table();
   last_mcu  = -1;
   cur_y     = 0;
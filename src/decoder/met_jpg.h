@@ -24,7 +24,15 @@
 /*****************************************************************************/
 
 void Mj_Dump_Image(void);
-void Mj_Dec_Mcus(uint8_t *p, uint32_t apid, int pck_cnt, int mcu_id, uint8_t q);
+void Mj_Dec_Mcus(
+        uint8_t *p,
+        int len,
+        uint32_t apid,
+        int pck_cnt,
+        int mcu_id,
+        uint8_t q);
+void Mj_Compose_Channels(void);
+void Mj_Sync(void);
 void Mj_Init(void);
 
 /*****************************************************************************/
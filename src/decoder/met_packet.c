@@ -17,11 +17,13 @@
 #include "met_packet.h"
 
 #include "../common/shared.h"
+#include "../glrpt/utils.h"
 #include "met_jpg.h"
 
 #include <glib.h>
 #include <gtk/gtk.h>
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -32,17 +34,61 @@
 
 #define PACKET_FULL_MARK    2047
 
+/* Virtual channels addressed by the 6-bit VCID of a VCDU */
+#define VCID_NUM            64
+
+/* Longest source packet that is reassembled, longer ones are dropped */
+#define PACKET_BUF_LEN      2048
+
+/* Source packets of APIDs 64 to 70 are queued, a power of 2 per APID */
+#define APID_QUEUE_FIRST    64
+#define APID_QUEUE_NUM      7
+#define APID_QUEUE_DEPTH    32
+
+/*****************************************************************************/
+
+/* Packet reassembly state of a virtual channel */
+typedef struct vc_state_t {
+    bool partial_packet;    /* A packet continues in the next frame */
+    int  last_frame;        /* VCDU counter of the last frame       */
+    int  packet_off;        /* Bytes of the packet reassembled yet  */
+    uint8_t packet_buf[PACKET_BUF_LEN];
+} vc_state_t;
+
+/* Source packet in a queue, stamped with its order of arrival */
+typedef struct packet_slot_t {
+    uint32_t seq;
+    int      len;
+    uint8_t  data[PACKET_BUF_LEN];
+} packet_slot_t;
+
+/* Lock-free queue of the packets of an APID, with the packet
+ * parser as its only producer and the decoder as its only consumer */
+typedef struct packet_queue_t {
+    atomic_uint head;       /* Packets taken by the consumer  */
+    atomic_uint tail;       /* Packets queued by the producer */
+    packet_slot_t slot[APID_QUEUE_DEPTH];
+} packet_queue_t;
+
 /*****************************************************************************/
 
 static void Parse_70(uint8_t *p);
-static void Act_Apd(uint8_t *p, uint32_t apid, int pck_cnt);
-static void Parse_Apd(uint8_t *p);
-static int Parse_Partial(uint8_t *p, int len);
+static void Act_Apd(uint8_t *p, int len, uint32_t apid, int pck_cnt);
+static void Parse_Apd(uint8_t *p, int len);
+static void Queue_Packet(uint8_t *p, int len);
+static int Parse_Partial(vc_state_t *vc, uint8_t *p, int len);
+static bool Append_Partial(vc_state_t *vc, uint8_t *p, int len);
 
 /*****************************************************************************/
 
-static bool partial_packet = false;
-static int last_frame = 0;
+static vc_state_t vc_state[VCID_NUM];
+static packet_queue_t apid_queue[APID_QUEUE_NUM];
+
+/* Arrival count of queued packets, so they are consumed in order */
+static uint32_t packet_seq = 0;
+
+/* Packets dropped because their queue was full */
+static atomic_int dropped_cnt = 0;
 
 /*****************************************************************************/
 
@@ -61,18 +107,22 @@ static void Parse_70(uint8_t *p) {
 
 /*****************************************************************************/
 
-static void Act_Apd(uint8_t *p, uint32_t apid, int pck_cnt) {
+static void Act_Apd(uint8_t *p, int len, uint32_t apid, int pck_cnt) {
   int mcu_id, q;
 
   mcu_id   = p[0];
   q = p[5];
 
-  Mj_Dec_Mcus( &p[6], apid, pck_cnt, mcu_id, (uint8_t)q );
+  Mj_Dec_Mcus( &p[6], len - 6, apid, pck_cnt, mcu_id, (uint8_t)q );
 }
 
 /*****************************************************************************/
 
-static void Parse_Apd(uint8_t *p) {
+/* Parse_Apd()
+ *
+ * Parses a space packet of len bytes taken from its APID queue
+ */
+static void Parse_Apd(uint8_t *p, int len) {
   uint16_t w;
   int pck_cnt;
   uint32_t apid;
@@ -91,44 +141,109 @@ static void Parse_Apd(uint8_t *p) {
   if( apid == 70 )
     Parse_70( &p[14] );
   else
-    Act_Apd( &p[14], apid, pck_cnt );
+    Act_Apd( &p[14], len - 14, apid, pck_cnt );
 }
 
 /*****************************************************************************/
 
-static int Parse_Partial(uint8_t *p, int len) {
+/* Queue_Packet()
+ *
+ * Pushes a complete space packet of len bytes into its APID
+ * queue. Packets of other APIDs, too short to hold the secondary
+ * header, or that find their queue full are dropped
+ */
+static void Queue_Packet(uint8_t *p, int len) {
+  packet_queue_t *queue;
+  packet_slot_t *slot;
+  uint32_t apid;
+  unsigned int tail;
+
+  apid = ( (uint32_t)(p[0] << 8) | p[1] ) & 0x07FF;
+  if( (apid < APID_QUEUE_FIRST) ||
+      (apid >= APID_QUEUE_FIRST + APID_QUEUE_NUM) ||
+      (len <= 14) || (len > PACKET_BUF_LEN) )
+    return;
+
+  queue = &apid_queue[apid - APID_QUEUE_FIRST];
+  tail  = atomic_load_explicit( &queue->tail, memory_order_relaxed );
+  if( tail - atomic_load_explicit(&queue->head, memory_order_acquire) ==
+      APID_QUEUE_DEPTH )
+  {
+    atomic_fetch_add( &dropped_cnt, 1 );
+    return;
+  }
+
+  slot = &queue->slot[tail & (APID_QUEUE_DEPTH - 1)];
+  slot->seq = packet_seq++;
+  slot->len = len;
+  memcpy( slot->data, p, (size_t)len );
+  atomic_store_explicit( &queue->tail, tail + 1, memory_order_release );
+}
+
+/*****************************************************************************/
+
+/* Parse_Partial()
+ *
+ * Queues the space packet at the start of len bytes, if it is
+ * complete, and returns its length. Otherwise marks the packet
+ * of the virtual channel as partial and returns 0
+ */
+static int Parse_Partial(vc_state_t *vc, uint8_t *p, int len) {
   int len_pck;
 
   if( len < 6 )
   {
-    partial_packet = true;
+    vc->partial_packet = true;
     return( 0 );
   }
 
   len_pck = ( p[4] << 8 ) | p[5];
   if( len_pck >= len - 6 )
   {
-    partial_packet = true;
+    vc->partial_packet = true;
     return( 0 );
   }
 
-  Parse_Apd( p );
+  Queue_Packet( p, len_pck + 6 + 1 );
 
-  partial_packet = false;
+  vc->partial_packet = false;
   return( len_pck + 6 + 1 );
 }
 
 /*****************************************************************************/
 
+/* Append_Partial()
+ *
+ * Appends len bytes to the packet reassembled in a virtual channel.
+ * A packet that would overrun the buffer is dropped, returning false
+ */
+static bool Append_Partial(vc_state_t *vc, uint8_t *p, int len) {
+  if( vc->packet_off + len > PACKET_BUF_LEN )
+  {
+    vc->partial_packet = false;
+    vc->packet_off = 0;
+    return( false );
+  }
+
+  memcpy( &vc->packet_buf[vc->packet_off], p, (size_t)len );
+  vc->packet_off += len;
+  return( true );
+}
+
+/*****************************************************************************/
+
+/* Parse_Cvcdu()
+ *
+ * Parses the M_PDU of a VCDU of len bytes, reassembling the space
+ * packets of each virtual channel separately and queuing them
+ */
 void Parse_Cvcdu(uint8_t *p, int len) {
   int n, data_len, off;
   int ver, fid;
   int frame_cnt;
   uint16_t hdr_off;
   uint16_t w;
-
-  static uint8_t packet_buf[2048];
-  static int packet_off = 0;
+  vc_state_t *vc;
 
   w = (uint16_t)( (p[0] << 8) | p[1] );
   ver = w >> 14;
@@ -141,42 +256,49 @@ void Parse_Cvcdu(uint8_t *p, int len) {
 
   if( (ver == 0) | (fid == 0) ) return; //Empty packet
 
+  vc = &vc_state[fid];
   data_len = len - 10;
-  if( frame_cnt == last_frame + 1 )
+  if( (hdr_off != PACKET_FULL_MARK) && (hdr_off > data_len) )
+  {
+    //Corrupt first header pointer
+    vc->partial_packet = false;
+    vc->packet_off = 0;
+    vc->last_frame = frame_cnt;
+    return;
+  }
+
+  if( frame_cnt == vc->last_frame + 1 )
   {
-    if( partial_packet )
+    if( vc->partial_packet )
     {
       if( hdr_off == PACKET_FULL_MARK ) //Packet could be larger than one frame
       {
-        hdr_off = (uint16_t)( len - 10 );
-        memmove( &packet_buf[packet_off], &p[10], hdr_off );
-        packet_off += hdr_off;
-      }
-      else
-      {
-        memmove( &packet_buf[packet_off], &p[10], hdr_off );
-        Parse_Partial( packet_buf, packet_off + hdr_off );
+        hdr_off = (uint16_t)data_len;
+        Append_Partial( vc, &p[10], hdr_off );
       }
+      else if( Append_Partial(vc, &p[10], hdr_off) )
+        Parse_Partial( vc, vc->packet_buf, vc->packet_off );
     }
   }
   else
   {
-    if( hdr_off == PACKET_FULL_MARK ) //Packet could be larger than one frame
-      return;
-    partial_packet = false;
-    packet_off = 0;
+    vc->partial_packet = false;
+    vc->packet_off = 0;
   }
-  last_frame = frame_cnt;
+  vc->last_frame = frame_cnt;
+
+  if( hdr_off == PACKET_FULL_MARK ) //Packet could be larger than one frame
+    return;
 
   data_len -= hdr_off;
   off = hdr_off;
   while( data_len > 0 )
   {
-    n = Parse_Partial( &p[10 + off], data_len );
-    if( partial_packet )
+    n = Parse_Partial( vc, &p[10 + off], data_len );
+    if( vc->partial_packet )
     {
-      packet_off = data_len;
-      memmove( packet_buf, &p[10 + off], (size_t)packet_off );
+      vc->packet_off = 0;
+      Append_Partial( vc, &p[10 + off], data_len );
       break;
     }
     else
@@ -186,3 +308,74 @@ void Parse_Cvcdu(uint8_t *p, int len) {
     }
   }
 }
+
+/*****************************************************************************/
+
+/* Mp_Dispatch_Packets()
+ *
+ * Consumer of the APID queues, hands the queued packets on to the
+ * image decoder in their order of arrival over all the APIDs
+ */
+void Mp_Dispatch_Packets(void) {
+  packet_queue_t *queue, *next;
+  packet_slot_t *slot, *next_slot;
+  unsigned int head;
+  int idx;
+
+  while( true )
+  {
+    /* Find the earliest packet at the heads of the queues */
+    next = NULL;
+    next_slot = NULL;
+    for( idx = 0; idx < APID_QUEUE_NUM; idx++ )
+    {
+      queue = &apid_queue[idx];
+      head  = atomic_load_explicit( &queue->head, memory_order_relaxed );
+      if( head == atomic_load_explicit(&queue->tail, memory_order_acquire) )
+        continue;
+
+      slot = &queue->slot[head & (APID_QUEUE_DEPTH - 1)];
+      if( (next == NULL) || ((int32_t)(slot->seq - next_slot->seq) < 0) )
+      {
+        next = queue;
+        next_slot = slot;
+      }
+    }
+    if( next == NULL ) break;
+
+    Parse_Apd( next_slot->data, next_slot->len );
+
+    head = atomic_load_explicit( &next->head, memory_order_relaxed );
+    atomic_store_explicit( &next->head, head + 1, memory_order_release );
+  }
+
+  if( atomic_exchange(&dropped_cnt, 0) > 0 )
+    Show_Message( "Packet queue overflow, packets dropped", "red" );
+}
+
+/*****************************************************************************/
+
+/* Mp_Init()
+ *
+ * Resets the virtual channels and empties the APID queues.
+ * Neither the producer nor the consumer may be running
+ */
+void Mp_Init(void) {
+  int idx;
+
+  for( idx = 0; idx < VCID_NUM; idx++ )
+  {
+    vc_state[idx].partial_packet = false;
+    vc_state[idx].last_frame = 0;
+    vc_state[idx].packet_off = 0;
+  }
+
+  for( idx = 0; idx < APID_QUEUE_NUM; idx++ )
+  {
+    atomic_store( &apid_queue[idx].head, 0 );
+    atomic_store( &apid_queue[idx].tail, 0 );
+  }
+
+  packet_seq = 0;
+  atomic_store( &dropped_cnt, 0 );
+}
@@ -24,6 +24,8 @@
 /*****************************************************************************/
 
 void Parse_Cvcdu(uint8_t *p, int len);
+void Mp_Dispatch_Packets(void);
+void Mp_Init(void);
 
 /*****************************************************************************/
 
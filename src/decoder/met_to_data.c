@@ -32,11 +32,31 @@
 
 #define MIN_CORRELATION 45
 
+/* Half width (in soft symbols) of the sync search
+ * window around the predicted position of the ASM */
+#define SYNC_WINDOW     256
+
+/* Frames lost in lock before falling back to a full search */
+#define SYNC_MAX_MISSES 4
+
+/* Length of the scrambled part of a frame, after the ASM */
+#define PN_SEQ_LEN      (HARD_FRAME_LEN - 4)
+
+/*****************************************************************************/
+
+/* Frame sync tracking states */
+enum {
+    SYNC_SEARCH = 0,    /* Search whole soft frames for the ASM  */
+    SYNC_LOCKED         /* Track the ASM where it is predicted   */
+};
+
 /*****************************************************************************/
 
-static void Do_Full_Correlate(mtd_rec_t *mtd, uint8_t *raw, uint8_t *aligned);
-static void Do_Next_Correlate(mtd_rec_t *mtd, uint8_t *raw, uint8_t *aligned);
-static bool Try_Frame(mtd_rec_t *mtd, uint8_t *aligned);
+static bool Do_Full_Correlate(mtd_rec_t *mtd, Soft_Ring_t *ring);
+static bool Do_Window_Correlate(mtd_rec_t *mtd, Soft_Ring_t *ring);
+static void Do_Next_Correlate(mtd_rec_t *mtd);
+static void Descramble(const uint8_t *in, uint8_t *out, const uint8_t *pn);
+static bool Try_Frame(mtd_rec_t *mtd, Soft_Ring_t *ring);
 
 /*****************************************************************************/
 
@@ -75,74 +95,148 @@ static const uint8_t prand[255] = {
     0x08, 0x78, 0xc4, 0x4a, 0x66, 0xf5, 0x58
 };
 
+/* The PN sequence over a whole frame, plain and complemented */
+static uint8_t pn_seq[2][PN_SEQ_LEN];
+
 static uint8_t *decoded = NULL;
 
 /*****************************************************************************/
 
 void Mtd_Init(mtd_rec_t *mtd) {
+  int j;
+
+  for( j = 0; j < PN_SEQ_LEN; j++ )
+  {
+    pn_seq[0][j] = prand[j % 255];
+    pn_seq[1][j] = prand[j % 255] ^ 0xFF;
+  }
+
   //sync is $1ACFFC1D,  00011010 11001111 11111100 00011101
   Correlator_Init( &(mtd->c), (uint64_t)0xfca2b63db00d9794 );
   Mk_Viterbi27( &(mtd->v) );
   mtd->pos  = 0;
+  mtd->prev_pos = 0;
   mtd->cpos = 0;
   mtd->word = 0;
   mtd->corr = 64;
+  mtd->sync_state  = SYNC_SEARCH;
+  mtd->sync_misses = 0;
 }
 
 /*****************************************************************************/
 
-static void Do_Full_Correlate(mtd_rec_t *mtd, uint8_t *raw, uint8_t *aligned) {
-  mtd->word = (uint16_t)
-    ( Corr_Correlate(&(mtd->c), &(raw[mtd->pos]), SOFT_FRAME_LEN) );
-  mtd->cpos = (uint16_t)( mtd->c.position[mtd->word] );
-  mtd->corr = (uint16_t)( mtd->c.correlation[mtd->word] );
+/* Do_Full_Correlate()
+ *
+ * Searches a whole soft frame for the ASM. If it is not found
+ * the position is advanced by a quarter frame and false returned
+ */
+static bool Do_Full_Correlate(mtd_rec_t *mtd, Soft_Ring_t *ring) {
+  int word;
+
+  word = Corr_Correlate(
+      &(mtd->c), Soft_Ring_At(ring, mtd->pos), SOFT_FRAME_LEN );
+  if( word < 0 )
+    mtd->corr = 0;
+  else
+  {
+    mtd->word = (uint32_t)word;
+    mtd->cpos = (uint32_t)( mtd->c.position[word] );
+    mtd->corr = (uint32_t)( mtd->c.correlation[word] );
+  }
 
   if( mtd->corr < MIN_CORRELATION )
   {
     mtd->prev_pos = mtd->pos;
-    memmove( aligned, &(raw[mtd->pos]), SOFT_FRAME_LEN );
     mtd->pos += SOFT_FRAME_LEN / 4;
+    return( false );
   }
-  else
-  {
-    mtd->prev_pos = mtd->pos + (int)mtd->cpos;
-
-    memmove(
-        aligned,
-        &(raw[mtd->pos + (int)mtd->cpos]),
-        SOFT_FRAME_LEN - mtd->cpos );
-    memmove(
-        &(aligned[SOFT_FRAME_LEN - mtd->cpos]),
-        &(raw[mtd->pos + SOFT_FRAME_LEN]),
-        mtd->cpos );
-    mtd->pos += SOFT_FRAME_LEN + mtd->cpos;
-
-    Fix_Packet( aligned, SOFT_FRAME_LEN, (int)mtd->word );
-  }
+
+  mtd->prev_pos = mtd->pos + (int64_t)mtd->cpos;
+  mtd->pos = mtd->prev_pos + SOFT_FRAME_LEN;
+  return( true );
+}
+
+/*****************************************************************************/
+
+/* Do_Window_Correlate()
+ *
+ * Searches for the ASM within SYNC_WINDOW soft symbols either side
+ * of its predicted position. The IQ ambiguity of the locked stream
+ * is preferred while it still correlates, so that a single noisy
+ * frame does not switch the rotation. Returns false if not found
+ */
+static bool Do_Window_Correlate(mtd_rec_t *mtd, Soft_Ring_t *ring) {
+  int64_t start;
+  int word;
+
+  start = mtd->pos - SYNC_WINDOW;
+  if( start < 0 ) start = 0;
+
+  word = Corr_Correlate( &(mtd->c), Soft_Ring_At(ring, start),
+      2 * SYNC_WINDOW + PATTERN_SIZE + 1 );
+  if( word < 0 ) return( false );
+
+  if( mtd->c.correlation[mtd->word] >= MIN_CORRELATION )
+    word = (int)mtd->word;
+  if( mtd->c.correlation[word] < MIN_CORRELATION )
+    return( false );
+
+  mtd->word = (uint32_t)word;
+  mtd->cpos = (uint32_t)( mtd->c.position[word] );
+  mtd->corr = (uint32_t)( mtd->c.correlation[word] );
+
+  mtd->prev_pos = start + (int64_t)mtd->cpos;
+  mtd->pos = mtd->prev_pos + SOFT_FRAME_LEN;
+  return( true );
 }
 
 /*****************************************************************************/
 
-static void Do_Next_Correlate(mtd_rec_t *mtd, uint8_t *raw, uint8_t *aligned) {
+static void Do_Next_Correlate(mtd_rec_t *mtd) {
   mtd->cpos = 0;
-  memmove( aligned, &(raw[mtd->pos]), SOFT_FRAME_LEN );
   mtd->prev_pos = mtd->pos;
   mtd->pos += SOFT_FRAME_LEN;
-
-  Fix_Packet( aligned, SOFT_FRAME_LEN, (int)mtd->word );
 }
 
 /*****************************************************************************/
 
-static bool Try_Frame(mtd_rec_t *mtd, uint8_t *aligned) {
+/* Descramble()
+ *
+ * XORs a frame with the given PN sequence, eight bytes at a time
+ */
+static void Descramble(const uint8_t *in, uint8_t *out, const uint8_t *pn) {
+  uint64_t w, p;
   int j;
-  uint8_t ecc_buf[256];
+
+  for( j = 0; j + 8 <= PN_SEQ_LEN; j += 8 )
+  {
+    memcpy( &w, &in[j], 8 );
+    memcpy( &p, &pn[j], 8 );
+    w ^= p;
+    memcpy( &out[j], &w, 8 );
+  }
+
+  for( ; j < PN_SEQ_LEN; j++ )
+    out[j] = in[j] ^ pn[j];
+}
+
+/*****************************************************************************/
+
+/* Try_Frame()
+ *
+ * Decodes the frame starting at prev_pos in the soft symbols ring, the
+ * IQ rotation/flip of the sync word being undone within the Viterbi
+ * metric rather than by rewriting the symbols
+ */
+static bool Try_Frame(mtd_rec_t *mtd, Soft_Ring_t *ring) {
+  int inverted;
   uint32_t temp;
 
   if( decoded == NULL )
     mem_alloc( (void **)&decoded, HARD_FRAME_LEN );
 
-  Vit_Decode( &(mtd->v), aligned, decoded );
+  Vit_Decode( &(mtd->v),
+      Soft_Ring_At(ring, mtd->prev_pos), decoded, (int)mtd->word );
 
   temp =
     ((uint32_t)decoded[3] << 24) +
@@ -157,50 +251,60 @@ static bool Try_Frame(mtd_rec_t *mtd, uint8_t *aligned) {
 
   //Curiously enough, you can flip all bits in a packet
   //and get a correct ECC anyway. Check for that case
-  if( Bitop_CountBits(mtd->last_sync ^ 0xE20330E5) <
-      Bitop_CountBits(mtd->last_sync ^ 0x1DFCCF1A) )
-  {
-    for( j = 0; j < HARD_FRAME_LEN; j++ )
-      decoded[j] ^= 0xFF;
-    temp =
-      ((uint32_t)decoded[3] << 24) +
-      ((uint32_t)decoded[2] << 16) +
-      ((uint32_t)decoded[1] <<  8) +
-      (uint32_t)decoded[0];
-    mtd->last_sync = temp;
-  }
+  inverted =
+    Bitop_CountBits(mtd->last_sync ^ 0xE20330E5) <
+    Bitop_CountBits(mtd->last_sync ^ 0x1DFCCF1A);
+  if( inverted )
+    mtd->last_sync ^= 0xFFFFFFFF;
 
-  for( j = 0; j < HARD_FRAME_LEN - 4; j++ )
-    decoded[4 + j] ^= prand[j % 255];
-
-  for( j = 0; j <= 3; j++ )
-  {
-    Ecc_Deinterleave( &(decoded[4]), ecc_buf, j, 4 );
-    mtd->r[j] = Ecc_Decode( ecc_buf, 0 );
-    Ecc_Interleave( ecc_buf, mtd->ecced_data, j, 4 );
-  }
+  /* The complemented PN sequence also undoes the inversion */
+  Descramble( &(decoded[4]), mtd->ecced_data, pn_seq[inverted] );
+  Ecc_Decode_Frame( mtd->ecced_data, mtd->r );
 
   return (mtd->r[0] && mtd->r[1] && mtd->r[2] && mtd->r[3]);
 }
 
 /*****************************************************************************/
 
-bool Mtd_One_Frame(mtd_rec_t *mtd, uint8_t *raw) {
-    uint8_t aligned[SOFT_FRAME_LEN];
+/* Mtd_One_Frame()
+ *
+ * Decodes the next frame from the soft symbols. While locked the
+ * frame is tried where it is predicted, then the ASM is searched for
+ * in a small window around that position. A frame that is not found
+ * is skipped (flywheel) and only after SYNC_MAX_MISSES consecutive
+ * misses is the lock dropped and whole frames searched for the ASM
+ */
+bool Mtd_One_Frame(mtd_rec_t *mtd, Soft_Ring_t *ring) {
     bool result = false;
 
-    if (mtd->cpos == 0) {
-        Do_Next_Correlate(mtd, raw, aligned);
-        result = Try_Frame(mtd, aligned);
+    if (mtd->sync_state == SYNC_LOCKED) {
+        Do_Next_Correlate(mtd);
+        result = Try_Frame(mtd, ring);
 
-        if (!result)
+        if (!result) {
             mtd->pos -= SOFT_FRAME_LEN;
+
+            if (Do_Window_Correlate(mtd, ring))
+                result = Try_Frame(mtd, ring);
+            else
+                mtd->pos += SOFT_FRAME_LEN;
+        }
+
+        if (result)
+            mtd->sync_misses = 0;
+        else if (++mtd->sync_misses >= SYNC_MAX_MISSES)
+            mtd->sync_state = SYNC_SEARCH;
     }
+    else if (Do_Full_Correlate(mtd, ring)) {
+        result = Try_Frame(mtd, ring);
 
-    if (!result) {
-        Do_Full_Correlate(mtd, raw, aligned);
-        result = Try_Frame(mtd, aligned);
+        if (result) {
+            mtd->sync_state  = SYNC_LOCKED;
+            mtd->sync_misses = 0;
+        }
     }
+    else
+        mtd->sig_q = 0;
 
     return result;
 }
@@ -19,6 +19,7 @@
 
 /*****************************************************************************/
 
+#include "../demodulator/soft_ring.h"
 #include "correlator.h"
 #include "viterbi27.h"
 
@@ -37,19 +38,23 @@ typedef struct mtd_rec_t {
     corr_rec_t c;
     viterbi27_rec_t v;
 
-    int pos, prev_pos;
+    /* Positions in the soft symbols stream */
+    int64_t pos, prev_pos;
     uint8_t ecced_data[HARD_FRAME_LEN];
 
     uint32_t word, cpos, corr, last_sync;
     int sig_q;
     bool r[4];
+
+    /* Frame sync tracking state and consecutive lost frames */
+    int sync_state, sync_misses;
 } mtd_rec_t;
 
 /*****************************************************************************/
 
 void Mtd_Init(mtd_rec_t *mtd);
 uint8_t **ret_decoded(void);
-bool Mtd_One_Frame(mtd_rec_t *mtd, uint8_t *raw);
+bool Mtd_One_Frame(mtd_rec_t *mtd, Soft_Ring_t *ring);
 
 /*****************************************************************************/
 
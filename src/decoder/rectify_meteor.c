@@ -40,13 +40,17 @@
 #include "rectify_meteor.h"
 
 #include "../common/shared.h"
+#include "../common/thread_pool.h"
 #include "../glrpt/utils.h"
 
 #include <math.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 /*****************************************************************************/
 
@@ -54,37 +58,99 @@
 #define	SAT_ALTITUDE    830.0  /* Satellite's average altitude in km */
 #define EARTH_RADIUS    6370.0 /* Earth's average radius in km */
 
+/* Remap weights are fixed point with this many fraction bits */
+#define MAP_WEIGHT_BITS 15
+#define MAP_WEIGHT_ONE  ( 1 << MAP_WEIGHT_BITS )
+
+/* Largest sum of the two weights of a remap entry. Function 1 rounds
+ * reciprocals up, so its thirds sum to one unit over MAP_WEIGHT_ONE,
+ * which still can't take a weighted sum of pixels past MAX_WHITE */
+#define MAP_WEIGHT_MAX  ( MAP_WEIGHT_ONE + 1 )
+
+/* Remap tables are saved in the cache directory, marked with this
+ * magic number (also telling the byte order) and format version */
+#define MAP_FILE_MAGIC      0x50414d52  /* "RMAP" */
+#define MAP_FILE_VERSION    1
+
+/*****************************************************************************/
+
+/* An entry of the remap table, one per rectified image pixel. Its
+ * value is that of two adjacent source pixels, weighted and summed */
+typedef struct rect_map_t {
+    uint32_t src;   /* Index of the first source pixel in its line */
+    uint16_t wa;    /* Weight of the source pixel at src           */
+    uint16_t wb;    /* Weight of the source pixel at src + 1       */
+} rect_map_t;
+
+/* Header of a saved remap table, holding all the parameters
+ * it was compiled for. It is followed by the table itself */
+typedef struct rect_map_file_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t function;      /* Rectify function                */
+    uint32_t in_width;      /* Width of the unrectified images */
+    uint32_t rect_width;    /* Width of the rectified images   */
+    uint32_t weight_bits;
+    double   phi_max;       /* Geometry of the scan            */
+    double   sat_altitude;
+    double   earth_radius;
+} rect_map_file_t;
+
+/* Arguments of the strip jobs of Rectify_Images() */
+typedef struct rect_job_t {
+    uint8_t *in[CHANNEL_IMAGE_NUM];     /* Unrectified channel images */
+    uint8_t *out[CHANNEL_IMAGE_NUM];    /* Rectified channel images   */
+    uint32_t height;
+    int      strips;                    /* Strips of lines per image  */
+    bool     flip;                      /* Rotate images by 180 deg.  */
+    uint32_t *hist;                     /* A histogram for each strip */
+} rect_job_t;
+
 /*****************************************************************************/
 
 static double Calculate_beta(double phi);
-static void Rectify_Grayscale_1(
-        uint8_t *in_buff,
+static uint32_t Rectified_Width(uint8_t function, uint32_t in_width);
+static void Set_Map_Ratio(
+        rect_map_t *map,
         uint32_t in_width,
-        uint32_t in_height,
-        uint8_t *rect_buff);
-static void Calculate_Pixel_Spacing_1(uint32_t in_width, uint32_t *rect_width);
-static void Rectify_Grayscale_2(
-        uint8_t *in_buff,
+        uint32_t src_a,
+        uint32_t src_b,
+        int ka, int kb, int div);
+static void Set_Map_Factor(
+        rect_map_t *map,
         uint32_t in_width,
-        uint32_t in_height,
-        uint8_t *rect_buff);
+        long src,
+        double factor);
+static void Calculate_Pixel_Spacing_1(uint32_t in_width, uint32_t *rect_width);
 static void Calculate_Pixel_Spacing_2(
         uint32_t orig_width,
         uint32_t *rect_width);
+static void Rectify_Line(
+        const uint8_t *in_line,
+        uint8_t *rect_line,
+        bool flip);
+static void Rectify_Strip(void *arg, int idx);
+static void Map_File_Header(
+        rect_map_file_t *header,
+        uint8_t function,
+        uint32_t in_width);
+static void Map_File_Name(
+        char *fname,
+        size_t len,
+        uint8_t function,
+        uint32_t in_width);
+static bool Load_Map(uint8_t function, uint32_t in_width);
+static void Save_Map(void);
 
 /*****************************************************************************/
 
-/* Gap between rectified pixels */
-static uint8_t *gap = NULL;
-
-/* Array that holds buffer indices for the reference
- * pixels that are the right ones to use to extrapolate
- * the value of rectified image pixels */
-static uint32_t *indices = NULL;
-
-/* Array of extrapolation factors needed to
- * calculate rectified image's pixel values */
-static double *factors = NULL;
+/* Remap table of the rectified image line, compiled for
+ * the input width and rectify function it was made for */
+static rect_map_t *rect_map = NULL;
+static uint32_t
+  map_in_width   = 0,
+  map_rect_width = 0;
+static uint8_t map_function = 0;
 
 /*****************************************************************************/
 
@@ -132,117 +198,109 @@ static double Calculate_beta(double phi) {
 
 /*****************************************************************************/
 
-/* Rectify_Grayscale_1()
+/* Rectified_Width()
  *
- * Corrects tangential geometric distortion and the effect
- * of Earth's curvature on the raw Meteor-M images.
+ * Returns the width in pixels of images of in_width
+ * pixels rectified by the given rectify function
  */
-static void Rectify_Grayscale_1(
-        uint8_t *in_buff,
-        uint32_t in_width,
-        uint32_t in_height,
-        uint8_t *rect_buff) {
-  uint8_t
-    byteA_right = 0,
-    byteB_right = 0,
-    byteA_left  = 0,
-    byteB_left  = 0;
+static uint32_t Rectified_Width(uint8_t function, uint32_t in_width) {
+  double
+    beta_max,   /* Max beta angle, corresponding to PHI_MAX */
+    delta_phi,  /* Incremental scan angle pixel-to-pixel    */
+    dwidth;     /* Width of the rectified image in float    */
 
-  uint32_t
-    in_width2,
-    ch_width2,
-    line_count,
-    in_buff_right,
-    in_buff_left,
-    rect_buff_right,
-    rect_buff_left,
-    idx;
+  /* Stride pixel-to-pixel of the scanner, in rad */
+  delta_phi = 2.0 * PHI_MAX / (double)( in_width - 1 );
 
+  /* Max beta angle, corresponding to Max phi  */
+  beta_max = Calculate_beta( PHI_MAX );
 
-  /* Rectify image buffer line by line */
-  in_width2 = in_width / 2;
-  ch_width2 = channel_image_width / 2;
-  for( line_count = 0; line_count < in_height; line_count++ )
+  /* Function 1 sizes rectified pixels as the first sub-satellite
+   * pixel. For function 2, the rectified image's pixels are along
+   * the arc on the surface of Earth, and the original scanner
+   * image's pixels are effectively on a circle of radius
+   * SAT_ALTITUDE, so this is the ratio of their widths */
+  if( function == 1 )
+    dwidth = 2.0 * beta_max / ( 2.0 * Calculate_beta(delta_phi / 2.0) );
+  else
+    dwidth = ceil( beta_max / Calculate_beta(delta_phi / 2.0) );
+
+  /* Now rounded to nearest multiple of 8 because
+   * this is prefered by the built-in JPEG compressor */
+  return( ((uint32_t)dwidth / 8) * 8 );
+}
+
+/*****************************************************************************/
+
+/* Set_Map_Ratio()
+ *
+ * Sets a remap entry to (ka * A + kb * B) / div, A and B being the
+ * adjacent source pixels at src_a and src_b. The weights are scaled
+ * by the reciprocal of div rounded up, which for the small ratios
+ * of rectify function 1 truncates exactly like an integer division
+ */
+static void Set_Map_Ratio(
+        rect_map_t *map,
+        uint32_t in_width,
+        uint32_t src_a,
+        uint32_t src_b,
+        int ka, int kb, int div) {
+  int recip = ( MAP_WEIGHT_ONE + div - 1 ) / div;
+
+  if( src_a <= src_b )
+  {
+    map->src = src_a;
+    map->wa  = (uint16_t)( ka * recip );
+    map->wb  = (uint16_t)( kb * recip );
+  }
+  else
   {
-    /* Middle of each line in the rectified image */
-    rect_buff_right = line_count * channel_image_width + ch_width2;
-    rect_buff_left  = rect_buff_right - 1;
+    map->src = src_b;
+    map->wa  = (uint16_t)( kb * recip );
+    map->wb  = (uint16_t)( ka * recip );
+  }
 
-    /* Middle of each line in the input image */
-    in_buff_right = line_count * in_width + in_width2;
-    in_buff_left  = in_buff_right - 1;
+  /* Keep the second source pixel inside the line */
+  if( map->src >= in_width - 1 )
+  {
+    map->src = in_width - 2;
+    map->wb  = map->wa;
+    map->wa  = 0;
+  }
+}
 
-    /* Get middle pixel right from input */
-    byteA_right = *( in_buff + in_buff_right++ );
+/*****************************************************************************/
 
-    /* Put it on the rectified line */
-    *( rect_buff + rect_buff_right++ ) = byteA_right;
+/* Set_Map_Factor()
+ *
+ * Sets a remap entry to the source pixel at src moved the given
+ * factor of the way towards the one at src + 1, as in function 2
+ */
+static void Set_Map_Factor(
+        rect_map_t *map,
+        uint32_t in_width,
+        long src,
+        double factor) {
+  long wb = lround( factor * (double)MAP_WEIGHT_ONE );
 
-    /* Get middle pixel left from input */
-    byteA_left = *( in_buff + in_buff_left-- );
+  if( wb < 0 ) wb = 0;
+  if( wb > MAP_WEIGHT_ONE ) wb = MAP_WEIGHT_ONE;
 
-    /* Put it on the rectified line */
-    *( rect_buff + rect_buff_left-- ) = byteA_left;
+  /* Keep both source pixels inside the line */
+  if( src < 0 )
+  {
+    src = 0;
+    wb  = 0;
+  }
+  else if( src > (long)in_width - 2 )
+  {
+    src = (long)in_width - 2;
+    wb  = MAP_WEIGHT_ONE;
+  }
 
-    /* Traverse the rest of the line */
-    for( idx = 0; idx < in_width2 - 1; idx++ )
-    {
-      /* Get the next pixel */
-      byteB_right = *( in_buff + in_buff_right++ );
-      byteB_left  = *( in_buff + in_buff_left-- );
-
-      /* Fill the gap between the two pixels */
-      switch ( *(gap + idx) )
-      {
-        case 0:
-          break;
-
-        /* Pad the space */
-        case 1:
-          *( rect_buff + rect_buff_right++ ) = ( byteA_right + byteB_right ) / 2;
-          *( rect_buff + rect_buff_left-- )  = ( byteA_left  + byteB_left )  / 2;
-          break;
-
-        case 2:
-          *( rect_buff + rect_buff_right++ ) = ( 2 * byteA_right + byteB_right ) / 3;
-          *( rect_buff + rect_buff_right++ ) = ( byteA_right + 2 * byteB_right ) / 3;
-          *( rect_buff + rect_buff_left-- )  = ( 2 * byteA_left  + byteB_left )  / 3;
-          *( rect_buff + rect_buff_left-- )  = ( byteA_left + 2  * byteB_left )  / 3;
-          break;
-
-        case 3:
-          *( rect_buff + rect_buff_right++ ) = ( 2 * byteA_right + byteB_right ) / 3;
-          *( rect_buff + rect_buff_right++ ) = ( byteA_right     + byteB_right ) / 2;
-          *( rect_buff + rect_buff_right++ ) = ( byteA_right     + 2 * byteB_right ) / 3;
-          *( rect_buff + rect_buff_left-- )  = ( 2 * byteA_left  + byteB_left ) / 3;
-          *( rect_buff + rect_buff_left-- )  = ( byteA_left      + byteB_left ) / 2;
-          *( rect_buff + rect_buff_left-- )  = ( byteA_left      + 2 * byteB_left ) / 3;
-          break;
-
-        case 4:
-          *( rect_buff + rect_buff_right++ ) = ( 3 * byteA_right + byteB_right ) / 4;
-          *( rect_buff + rect_buff_right++ ) = ( 2 * byteA_right + byteB_right ) / 3;
-          *( rect_buff + rect_buff_right++ ) = ( byteA_right + 2 * byteB_right ) / 3;
-          *( rect_buff + rect_buff_right++ ) = ( byteA_right + 3 * byteB_right ) / 4;
-          *( rect_buff + rect_buff_left-- )  = ( 3 * byteA_left  + byteB_left )  / 4;
-          *( rect_buff + rect_buff_left-- )  = ( 2 * byteA_left  + byteB_left )  / 3;
-          *( rect_buff + rect_buff_left-- )  = ( byteA_left + 2  * byteB_left )  / 3;
-          *( rect_buff + rect_buff_left-- )  = ( byteA_left + 3  * byteB_left )  / 4;
-          break;
-
-        default:
-          fprintf(stderr, "\nglrpt: A problem occurred spacing the pixels\n" );
-          break;
-      } /* switch ( *( gap + idx) ) */
-
-      /* And write the pixel */
-      *( rect_buff + rect_buff_right++ ) = byteB_right;
-      byteA_right  = byteB_right;
-      *( rect_buff + rect_buff_left-- )  = byteB_left;
-      byteA_left   = byteB_left;
-
-    } /* for( idx = 0; idx < in_width-1; idx++ ) */
-  } /* for( line_count = 0; line_count < height; line_count++ ) */
+  map->src = (uint32_t)src;
+  map->wa  = (uint16_t)( MAP_WEIGHT_ONE - wb );
+  map->wb  = (uint16_t)wb;
 }
 
 /*****************************************************************************/
@@ -250,7 +308,9 @@ static void Rectify_Grayscale_1(
 /* Calculate_Pixel_Spacing_1()
  *
  * Calculates the correct pixel spacing of Meteor-M images taking into
- * account the Earth's curvature and the scanner's tangential distortion
+ * account the Earth's curvature and the scanner's tangential distortion,
+ * and compiles the gaps between pixels into the remap table. The gaps are
+ * filled by interpolating between the pixels on either side of them
  */
 static void Calculate_Pixel_Spacing_1(uint32_t in_width, uint32_t *rect_width) {
   /* A little geometry of the satellite, Earth, and the scans */
@@ -259,25 +319,41 @@ static void Calculate_Pixel_Spacing_1(uint32_t in_width, uint32_t *rect_width) {
     delta_phi,   // incremental scan angle pixel-to-pixel
     beta,        // Angle on center of earth corresponding to phi
     beta_max,
-    resolution,
-    dwidth;
+    resolution;
 
   uint32_t
     idx,
     in_width2; // Middle right pixel of input image
 
+  /* Weights of the pixels either side of a gap, per size of gap */
+  static const int gap_ratio[5][4][3] = {
+    { { 0 } },
+    { { 1, 1, 2 } },
+    { { 2, 1, 3 }, { 1, 2, 3 } },
+    { { 2, 1, 3 }, { 1, 1, 2 }, { 1, 2, 3 } },
+    { { 3, 1, 4 }, { 2, 1, 3 }, { 1, 2, 3 }, { 1, 3, 4 } }
+  };
+
   /* Unfilled gaps between true pixel locations */
   double unusedspace = 0.0;
 
+  /* Gap between rectified pixels */
+  uint8_t *gap = NULL;
+
+  /* Next rectified pixels right and left of the center */
+  uint32_t right, left, rect_width2;
+
+  /* Source pixels either side of a gap, right and left of the center */
+  uint32_t a_right, b_right, a_left, b_left;
+
+  const int *ratio;
+  int cnt;
+
   /* New position of rectified pixels */
   in_width2 = in_width / 2;
   double *newposition = NULL;
-  if( newposition == NULL )
-    mem_alloc( (void **) &newposition, (size_t)in_width2 * sizeof(double) );
-
-  /* Gap between pixels */
-  if( gap == NULL )
-    mem_alloc( (void **)&gap, (size_t)(in_width2 - 1) * sizeof(int) );
+  mem_alloc( (void **) &newposition, (size_t)in_width2 * sizeof(double) );
+  mem_alloc( (void **)&gap, (size_t)(in_width2 - 1) * sizeof(uint8_t) );
 
   /* Stride pixel-to-pixel of the scanner, in rad */
   delta_phi = 2.0 * PHI_MAX / (double)( in_width - 1 );
@@ -285,23 +361,12 @@ static void Calculate_Pixel_Spacing_1(uint32_t in_width, uint32_t *rect_width) {
   /* Max beta angle, corresponding to Max phi  */
   beta_max = Calculate_beta( PHI_MAX );
 
-  /* The size of first sub-satellite pixel */
-  resolution = 2.0 * Calculate_beta( delta_phi / 2.0 );
-
-  /* This is the width of rectified image in float */
-  dwidth = 2.0 * beta_max / resolution;
-
-  /* And this is the width in pixels of the rectified image */
-  *rect_width = (uint32_t)dwidth;
-
-  /* Now rounded to nearest multiple of 8 because
-   * this is prefered by the built-in JPEG compressor */
-  *rect_width = ( *rect_width / 8 ) * 8;
+  /* The width in pixels of the rectified image */
+  *rect_width = Rectified_Width( 1, in_width );
 
   /* Reference size of pixels in rectified image */
   resolution = 2.0 * beta_max / (double)( *rect_width - 1 );
 
-  /* Calculate the correct position of each pixel */
   /* Calculate the correct position of each pixel */
   for( idx = 0; idx < in_width2; idx++ )
   {
@@ -311,8 +376,7 @@ static void Calculate_Pixel_Spacing_1(uint32_t in_width, uint32_t *rect_width) {
   }
 
   /* Calculate number of gaps between rectified pixels */
-  in_width2--;
-  for( idx = 0; idx < in_width2; idx++ )
+  for( idx = 0; idx < in_width2 - 1; idx++ )
   {
     unusedspace += newposition[ idx + 1 ] - newposition[ idx ] - 1.0;
     if( unusedspace >= 4.0 )
@@ -341,79 +405,50 @@ static void Calculate_Pixel_Spacing_1(uint32_t in_width, uint32_t *rect_width) {
     }
   }
 
-  free_ptr( (void **) &newposition );
-}
-
-/*****************************************************************************/
-
-/* Rectify_Grayscale_2()
- *
- * Corrects tangential geometric distortion and the effect
- * of Earth's curvature on the raw Meteor-M scanner images.
- */
-static void Rectify_Grayscale_2(
-        uint8_t *in_buff,
-        uint32_t in_width,
-        uint32_t in_height,
-        uint8_t *rect_buff) {
-  uint32_t
-    in_buff_idx,    /* Index to the unrectified input image buffer    */
-    rect_buff_idx,  /* Index to the rectified output image buffer     */
-    in_width2,      /* Half the width (center) of input image buffer  */
-    rect_width2;    /* Half the width (center) of output image buffer */
-
-  uint32_t
-    horiz_cnt,  /* Count of pixels created in the rectified image buffer */
-    vert_cnt,   /* Count of lines of input/output images processed       */
-    in_stride;  /* Dist. in pixels of the current image line into buffer */
-
-  double
-    pixel_value_diff,   /* Difference of values of two adjacent input pixels */
-    pixel_value;        /* Extrapolated value of a pixel in rectified buffer */
-
-  /* The center pixels (first to right of center) of images */
-  in_width2   = in_width / 2;
-  rect_width2 = channel_image_width / 2;
-
-  /* Rectify images lane by line */
-  for( vert_cnt = 0; vert_cnt < in_height; vert_cnt++ )
+  /* Rectified pixels not reached by the input line stay black */
+  mem_realloc( (void **)&rect_map, (size_t)*rect_width * sizeof(rect_map_t) );
+  memset( rect_map, 0, (size_t)*rect_width * sizeof(rect_map_t) );
+
+  /* Lay out the line from its middle pixels to the edges.
+   * left wraps around below 0 when the line is complete */
+  rect_width2 = *rect_width / 2;
+  right = rect_width2;
+  left  = rect_width2 - 1;
+  Set_Map_Ratio( &rect_map[right++], in_width,
+      in_width2, in_width2, 1, 0, 1 );
+  Set_Map_Ratio( &rect_map[left--], in_width,
+      in_width2 - 1, in_width2 - 1, 1, 0, 1 );
+
+  for( idx = 0; idx < in_width2 - 1; idx++ )
   {
-    /* Indices to input and output image buffers */
-    rect_buff_idx = rect_width2 + vert_cnt * channel_image_width;
-    in_stride     = in_width2   + vert_cnt * in_width;
+    a_right = in_width2 + idx;
+    b_right = a_right + 1;
+    a_left  = in_width2 - idx - 1;
+    b_left  = a_left - 1;
 
-    /* Extrapolate values of each pixel in output buffer.
-     * This is from center right pixel to the right edges */
-    for( horiz_cnt = 0; horiz_cnt < rect_width2; horiz_cnt++ )
+    /* Fill the gap between the two pixels */
+    for( cnt = 0; cnt < gap[idx]; cnt++ )
     {
-      /* This index points to pixel in input buffer that is to
-       * be used as the reference for extrapolating pixel value */
-      in_buff_idx = indices[horiz_cnt] + in_stride;
-
-      /* This is the diff in values of the reference pixel and the one
-       * before it, and it is to be used for linear extrapolation of the
-       * value of the current pixel of the output (rectified) buffer */
-      pixel_value_diff = in_buff[in_buff_idx - 1] - in_buff[in_buff_idx];
-
-      /* Pixel value is the reference input pixel value  plus a propotion
-       * of the value diff above, according to the extrapolation factor */
-      pixel_value = in_buff[in_buff_idx] + pixel_value_diff * factors[horiz_cnt];
-      rect_buff[rect_buff_idx] = (uint8_t)pixel_value;
-      rect_buff_idx++;
+      ratio = gap_ratio[ gap[idx] ][cnt];
+      if( right < *rect_width )
+        Set_Map_Ratio( &rect_map[right++], in_width,
+            a_right, b_right, ratio[0], ratio[1], ratio[2] );
+      if( left < rect_width2 )
+        Set_Map_Ratio( &rect_map[left--], in_width,
+            a_left, b_left, ratio[0], ratio[1], ratio[2] );
     }
 
-    /* Extrapolate values of each pixel in output buffer as above.
-     * This is from the center left pixel to the left edges */
-    rect_buff_idx = rect_width2 + vert_cnt * channel_image_width;
-    for( horiz_cnt = 0; horiz_cnt < rect_width2; horiz_cnt++ )
-    {
-      in_buff_idx = in_stride - indices[horiz_cnt];
-      pixel_value_diff = in_buff[in_buff_idx - 1] - in_buff[in_buff_idx];
-      pixel_value = in_buff[in_buff_idx - 1] - pixel_value_diff * factors[horiz_cnt];
-      rect_buff_idx--;
-      rect_buff[rect_buff_idx] = (uint8_t)pixel_value;
-    }
-  } /* for( horiz_cnt = 0; horiz_cnt < rect_width2; horiz_cnt++ ) */
+    /* And the pixel itself */
+    if( right < *rect_width )
+      Set_Map_Ratio( &rect_map[right++], in_width,
+          b_right, b_right, 1, 0, 1 );
+    if( left < rect_width2 )
+      Set_Map_Ratio( &rect_map[left--], in_width,
+          b_left, b_left, 1, 0, 1 );
+  }
+
+  free_ptr( (void **) &gap );
+  free_ptr( (void **) &newposition );
 }
 
 /*****************************************************************************/
@@ -422,7 +457,9 @@ static void Rectify_Grayscale_2(
  *
  * Calculates the correct pixel spacing of Meteor-M
  * images taking into account the Earth's curvature
- * and the scanner's tangential distortion
+ * and the scanner's tangential distortion, and compiles
+ * it into the remap table. Rectified pixels are linearly
+ * extrapolated from the nearest original pixels
  */
 static void Calculate_Pixel_Spacing_2(
         uint32_t orig_width,
@@ -437,8 +474,7 @@ static void Calculate_Pixel_Spacing_2(
     delta_center2,  /* Half the above delta */
     orig_pixel_center, /* Distance of orig. pixels' center from sub-satellite point */
     rect_pixel_center, /* Distance of rect. pixels' center from sub-satellite point */
-    prev_center,       /* Distance as above of the previous pixel */
-    dwidth;
+    prev_center;       /* Distance as above of the previous pixel */
 
   uint32_t
     rect_idx,    /* Index to rectified image buffer */
@@ -447,6 +483,12 @@ static void Calculate_Pixel_Spacing_2(
 
   size_t req;
 
+  /* Indices to the buffer of the original image for the
+   * appropriate pixels to use to extrapolate pixel values
+   * of the rectified image, and the extrapolation factors */
+  uint32_t *indices = NULL;
+  double   *factors = NULL;
+
   /* Calculate beta_max and the width in pixels of rectified image */
   beta_max = Calculate_beta( PHI_MAX );
 
@@ -454,18 +496,8 @@ static void Calculate_Pixel_Spacing_2(
   delta_phi  = 2.0 * PHI_MAX / (double)( orig_width - 1 );
   delta_phi2 = delta_phi / 2.0;
 
-  /* The rectified image's pixels are along the arc on the
-   * surface of Earth, and the original scanner image's pixels
-   * are effectively on a circle of radius SAT_ALTITUDE. This
-   * is the ratio of rectified image to original image width */
-  dwidth = beta_max / Calculate_beta( delta_phi2 );
-
-  /* And this is the width in pixels of the rectified image */
-  *rect_width = (uint32_t)( ceil(dwidth) );
-
-  /* Now rounded to nearest multiple of 8 because
-   * this is prefered by the built-in JPEG compressor */
-  *rect_width = ( *rect_width / 8 ) * 8;
+  /* The width in pixels of the rectified image */
+  *rect_width = Rectified_Width( 2, orig_width );
 
   /* Allocate the indices buffer. It holds indices to the buffer
    * of the original image for the appropriate pixels to use
@@ -529,67 +561,356 @@ static void Calculate_Pixel_Spacing_2(
     factors[rect_idx] /= prev_center - orig_pixel_center;
     rect_idx++;
   } /* while( rect_idx < rect_center ) */
+
+  /* Compile the extrapolation of the pixels right and left of center */
+  mem_realloc( (void **)&rect_map, (size_t)*rect_width * sizeof(rect_map_t) );
+  memset( rect_map, 0, (size_t)*rect_width * sizeof(rect_map_t) );
+  for( rect_idx = 0; rect_idx < rect_center; rect_idx++ )
+  {
+    Set_Map_Factor( &rect_map[rect_center + rect_idx], orig_width,
+        (long)(orig_width / 2) + (long)indices[rect_idx] - 1,
+        1.0 - factors[rect_idx] );
+    Set_Map_Factor( &rect_map[rect_center - rect_idx - 1], orig_width,
+        (long)(orig_width / 2) - (long)indices[rect_idx] - 1,
+        factors[rect_idx] );
+  }
+
+  free_ptr( (void **)&indices );
+  free_ptr( (void **)&factors );
 }
 
 /*****************************************************************************/
 
-/* Rectify_Images()
+/* Rectify_Line()
  *
- * Rectifies (corrects geometric distortion) of Meteor images
+ * Corrects tangential geometric distortion and the effect of Earth's
+ * curvature on a line of the raw Meteor-M images, by applying the
+ * remap table. Every rectified pixel costs two loads and a weighted
+ * sum, with no branches on the pixel spacing. A flipped line is read
+ * from its end, which rotates the image by 180 degrees on the way
  */
-void Rectify_Images(void) {
-  /* Create a temp image buffer to save original images
-   * and re-allocate channel images to be rectified */
-  uint8_t *temp_image = NULL;
-  size_t   orig_size  = (size_t)( channel_image_width * channel_image_height );
-  orig_size *= sizeof(uint8_t);
-  mem_alloc( (void **) &temp_image, orig_size );
-
-  /* Initialize rectifying functions. channel_image_width
-   * will become the new width of the rectified images */
+static void Rectify_Line(
+        const uint8_t *in_line,
+        uint8_t *rect_line,
+        bool flip) {
+  const rect_map_t *map;
+  const uint8_t *in_end;
+  uint32_t idx;
+
+  if( flip )
+  {
+    in_end = in_line + map_in_width - 1;
+    for( idx = 0; idx < map_rect_width; idx++ )
+    {
+      map = &rect_map[idx];
+      rect_line[idx] = (uint8_t)(
+          ( in_end[-(long)map->src]     * map->wa +
+            in_end[-(long)map->src - 1] * map->wb ) >> MAP_WEIGHT_BITS );
+    }
+  }
+  else
+  {
+    for( idx = 0; idx < map_rect_width; idx++ )
+    {
+      map = &rect_map[idx];
+      rect_line[idx] = (uint8_t)(
+          ( in_line[map->src]     * map->wa +
+            in_line[map->src + 1] * map->wb ) >> MAP_WEIGHT_BITS );
+    }
+  }
+}
+
+/*****************************************************************************/
+
+/* Rectify_Strip()
+ *
+ * Rectifies a strip of lines of a channel image, idx counting
+ * the strips of all channel images one channel after the other.
+ * The histogram of the strip is built while its lines are in cache
+ */
+static void Rectify_Strip(void *arg, int idx) {
+  rect_job_t *job = (rect_job_t *)arg;
+  int chan  = idx / job->strips;
+  int strip = idx % job->strips;
+  uint32_t first, last, line, in_line, cnt;
+  uint32_t *hist;
+  uint8_t *rect_line;
+
+  first = (uint32_t)( (uint64_t)job->height * (uint64_t)strip / (uint64_t)job->strips );
+  last  = (uint32_t)( (uint64_t)job->height * (uint64_t)(strip + 1) / (uint64_t)job->strips );
+  hist  = &job->hist[ idx * (MAX_WHITE+1) ];
+
+  for( line = first; line < last; line++ )
+  {
+    in_line   = job->flip ? job->height - 1 - line : line;
+    rect_line = job->out[chan] + (size_t)line * map_rect_width;
+    Rectify_Line( job->in[chan] + (size_t)in_line * map_in_width,
+        rect_line, job->flip );
+
+    for( cnt = 0; cnt < map_rect_width; cnt++ )
+      hist[ rect_line[cnt] ]++;
+  }
+}
+
+/*****************************************************************************/
+
+/* Map_File_Header()
+ *
+ * Fills the header of a saved remap table
+ * for the given function and input width
+ */
+static void Map_File_Header(
+        rect_map_file_t *header,
+        uint8_t function,
+        uint32_t in_width) {
+  memset( header, 0, sizeof(rect_map_file_t) );
+  header->magic        = MAP_FILE_MAGIC;
+  header->version      = MAP_FILE_VERSION;
+  header->function     = function;
+  header->in_width     = in_width;
+  header->weight_bits  = MAP_WEIGHT_BITS;
+  header->phi_max      = PHI_MAX;
+  header->sat_altitude = SAT_ALTITUDE;
+  header->earth_radius = EARTH_RADIUS;
+}
+
+/*****************************************************************************/
+
+/* Map_File_Name()
+ *
+ * Makes the path of the saved remap table
+ * for the given function and input width
+ */
+static void Map_File_Name(
+        char *fname,
+        size_t len,
+        uint8_t function,
+        uint32_t in_width) {
+  snprintf( fname, len, "%s/rectify-%u-%u.map",
+      rc_data.glrpt_imgs, (unsigned)function, in_width );
+}
+
+/*****************************************************************************/
+
+/* Load_Map()
+ *
+ * Loads the remap table saved for the given function and input
+ * width, if there is one made with the same scan geometry and
+ * rectified width, all of whose entries are within the input
+ * line and weights in range. Returns false if it has to be
+ * calculated instead
+ */
+static bool Load_Map(uint8_t function, uint32_t in_width) {
+  char fname[MAX_FILE_NAME];
+  rect_map_file_t header, expect;
+  uint32_t idx;
+  FILE *fp;
+  bool ok;
+
+  Map_File_Name( fname, sizeof(fname), function, in_width );
+  fp = fopen( fname, "rb" );
+  if( fp == NULL ) return( false );
+
+  /* All the parameters must match, the rectified width too */
+  Map_File_Header( &expect, function, in_width );
+  expect.rect_width = Rectified_Width( function, in_width );
+  ok = ( fread(&header, sizeof(header), 1, fp) == 1 );
+  ok = ok && ( memcmp(&header, &expect, sizeof(header)) == 0 );
+
+  if( ok )
+  {
+    mem_realloc( (void **)&rect_map,
+        (size_t)header.rect_width * sizeof(rect_map_t) );
+    ok = ( fread(rect_map, sizeof(rect_map_t), header.rect_width, fp) ==
+        header.rect_width );
+  }
+  fclose( fp );
+
+  /* Reject entries that would read past the input line
+   * or whose weighted sum could overflow a pixel value */
+  for( idx = 0; ok && (idx < header.rect_width); idx++ )
+    ok = ( rect_map[idx].src < in_width - 1 ) &&
+      ( (uint32_t)rect_map[idx].wa + rect_map[idx].wb <= MAP_WEIGHT_MAX );
+
+  if( ok ) map_rect_width = header.rect_width;
+  return( ok );
+}
+
+/*****************************************************************************/
+
+/* Save_Map()
+ *
+ * Saves the remap table in the cache directory, to spare
+ * calculating it again in later sessions. It is written to
+ * a temporary file first and then renamed, so that a table
+ * is never left there half written
+ */
+static void Save_Map(void) {
+  char fname[MAX_FILE_NAME], temp[MAX_FILE_NAME];
+  rect_map_file_t header;
+  FILE *fp;
+  bool ok;
+  int fd;
+
+  Map_File_Name( fname, sizeof(fname), map_function, map_in_width );
+  snprintf( temp, sizeof(temp), "%s/rectify-XXXXXX", rc_data.glrpt_imgs );
+  fd = mkstemp( temp );
+  fp = ( fd < 0 ) ? NULL : fdopen( fd, "wb" );
+  if( fp == NULL )
+  {
+    perror( "glrpt: Failed to save rectify map" );
+    if( fd >= 0 )
+    {
+      close( fd );
+      remove( temp );
+    }
+    return;
+  }
+
+  Map_File_Header( &header, map_function, map_in_width );
+  header.rect_width = map_rect_width;
+  ok = ( fwrite(&header, sizeof(header), 1, fp) == 1 ) &&
+    ( fwrite(rect_map, sizeof(rect_map_t), map_rect_width, fp) ==
+      map_rect_width );
+  if( (fclose(fp) != 0) || !ok || (rename(temp, fname) != 0) )
+  {
+    perror( "glrpt: Failed to save rectify map" );
+    remove( temp );
+  }
+}
+
+/*****************************************************************************/
+
+/* Rectify_Prepare()
+ *
+ * Compiles the remap table for the rectify function in use, if not
+ * done already, and returns the width of rectified images or 0 if
+ * rectifying is off. The table is loaded from the cache directory if
+ * saved there by an earlier session, else it is calculated and saved.
+ * Announces the function if announce is true
+ */
+uint32_t Rectify_Prepare(bool announce) {
   switch( rc_data.rectify_function )
   {
     case 1:
-      Show_Message( "Using Rectify Function 1 (W2RG)", "green" );
-      Calculate_Pixel_Spacing_1( METEOR_IMAGE_WIDTH, &channel_image_width );
+      if( announce )
+        Show_Message( "Using Rectify Function 1 (W2RG)", "green" );
       break;
 
     case 2:
-      Show_Message( "Using Rectify Function 2 (5B4AZ)", "green" );
-      Calculate_Pixel_Spacing_2( METEOR_IMAGE_WIDTH, &channel_image_width );
+      if( announce )
+        Show_Message( "Using Rectify Function 2 (5B4AZ)", "green" );
       break;
+
+    default:
+      return( 0 );
   }
 
-  size_t new_size = (size_t)(channel_image_width * channel_image_height);
-  new_size *= sizeof(uint8_t);
+  if( (rect_map == NULL) ||
+      (map_function != rc_data.rectify_function) ||
+      (map_in_width != METEOR_IMAGE_WIDTH) )
+  {
+    map_function = rc_data.rectify_function;
+    map_in_width = METEOR_IMAGE_WIDTH;
+    if( !Load_Map(map_function, map_in_width) )
+    {
+      if( map_function == 1 )
+        Calculate_Pixel_Spacing_1( map_in_width, &map_rect_width );
+      else
+        Calculate_Pixel_Spacing_2( map_in_width, &map_rect_width );
+      Save_Map();
+    }
+  }
 
-  /* The size of the channel images will also increase */
-  channel_image_size = new_size;
+  return( map_rect_width );
+}
 
-  /* Rectify image channels */
-  for( uint8_t idx = 0; idx < CHANNEL_IMAGE_NUM; idx++ )
+/*****************************************************************************/
+
+/* Rectify_Lines()
+ *
+ * Rectifies lines of an unrectified image into the same lines of a
+ * rectified one, adding their pixels to the histogram hist. Each line
+ * is mirrored if flip is true, so flipping the whole image only needs
+ * its lines reversed in order afterwards. Needs Rectify_Prepare()
+ */
+void Rectify_Lines(
+        const uint8_t *in_buff,
+        uint8_t *rect_buff,
+        uint32_t lines,
+        bool flip,
+        uint32_t *hist) {
+  uint32_t line, cnt;
+  uint8_t *rect_line;
+
+  for( line = 0; line < lines; line++ )
   {
-    /* Save original image to temp */
-    memmove( temp_image, channel_image[idx], orig_size );
+    rect_line = rect_buff + (size_t)line * map_rect_width;
+    Rectify_Line( in_buff + (size_t)line * map_in_width, rect_line, flip );
 
-    /* Re-allocate image buffer and rectify */
-    mem_realloc( (void **) &channel_image[idx], new_size );
-    switch( rc_data.rectify_function )
+    for( cnt = 0; cnt < map_rect_width; cnt++ )
+      hist[ rect_line[cnt] ]++;
+  }
+}
+
+/*****************************************************************************/
+
+/* Rectify_Images()
+ *
+ * Rectifies (corrects geometric distortion) of Meteor images, flipping
+ * them too if flip is true. The histograms of the rectified images are
+ * stored in hist[CHANNEL_IMAGE_NUM][MAX_WHITE+1], for normalization.
+ * Returns false, leaving the images as they are, if rectifying is off
+ */
+bool Rectify_Images(bool flip, uint32_t hist[][MAX_WHITE+1]) {
+  rect_job_t job;
+  size_t new_size;
+  uint8_t idx;
+  int strip, val;
+
+  if( Rectify_Prepare(true) == 0 )
+    return( false );
+
+  if( flip )
+    Show_Message( "Rotating Image by 180 degrees", "black" );
+
+  /* channel_image_width becomes the width of the rectified images */
+  channel_image_width = map_rect_width;
+  new_size = (size_t)channel_image_width * channel_image_height;
+  channel_image_size = new_size;
+
+  /* Rectify image channels into new buffers, in strips of lines */
+  for( idx = 0; idx < CHANNEL_IMAGE_NUM; idx++ )
+  {
+    job.in[idx]  = channel_image[idx];
+    job.out[idx] = NULL;
+    mem_alloc( (void **)&job.out[idx], new_size );
+  }
+  job.height = channel_image_height;
+  job.strips = Pool_Strips( thread_pool, (int)channel_image_height, 16 );
+  job.flip   = flip;
+  job.hist   = NULL;
+  mem_alloc( (void **)&job.hist, (size_t)(CHANNEL_IMAGE_NUM * job.strips) *
+      (MAX_WHITE+1) * sizeof(uint32_t) );
+  Pool_For( thread_pool, CHANNEL_IMAGE_NUM * job.strips, Rectify_Strip, &job );
+
+  /* Merge the histograms of the strips of each channel */
+  for( idx = 0; idx < CHANNEL_IMAGE_NUM; idx++ )
+    for( val = 0; val <= MAX_WHITE; val++ )
     {
-      case 1:
-        Rectify_Grayscale_1(
-            temp_image, METEOR_IMAGE_WIDTH,
-            channel_image_height, channel_image[idx] );
-        break;
-
-      case 2:
-        Rectify_Grayscale_2(
-            temp_image, METEOR_IMAGE_WIDTH,
-            channel_image_height, channel_image[idx] );
-        break;
+      hist[idx][val] = 0;
+      for( strip = 0; strip < job.strips; strip++ )
+        hist[idx][val] +=
+          job.hist[ (idx * job.strips + strip) * (MAX_WHITE+1) + val ];
     }
+  free_ptr( (void **)&job.hist );
+
+  for( idx = 0; idx < CHANNEL_IMAGE_NUM; idx++ )
+  {
+    free_ptr( (void **)&channel_image[idx] );
+    channel_image[idx] = job.out[idx];
   }
 
   SetFlag( IMAGES_RECTIFIED );
-  free_ptr( (void **) &temp_image );
+  return( true );
 }
@@ -19,7 +19,21 @@
 
 /*****************************************************************************/
 
-void Rectify_Images(void);
+#include "../glrpt/image.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*****************************************************************************/
+
+uint32_t Rectify_Prepare(bool announce);
+void Rectify_Lines(
+        const uint8_t *in_buff,
+        uint8_t *rect_buff,
+        uint32_t lines,
+        bool flip,
+        uint32_t *hist);
+bool Rectify_Images(bool flip, uint32_t hist[][MAX_WHITE+1]);
 
 /*****************************************************************************/
 
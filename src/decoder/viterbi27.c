@@ -301,7 +301,7 @@ static void Vit_Inner(viterbi27_rec_t *v, uint8_t *soft) {
     {
       int idx = (soft[i * 2 + 1] << 8) + soft[i * 2];
       v->write_errors[j] =
-        v->dist_table[v->table[j]][idx] + v->read_errors[j >> 1];
+        v->dist_table[v->perm[v->table[j]]][idx] + v->read_errors[j >> 1];
     }
     Error_Buffer_Swap( v );
   }
@@ -311,7 +311,7 @@ static void Vit_Inner(viterbi27_rec_t *v, uint8_t *soft) {
     for( j = 0; j <= 3; j++ )
     {
       int idx = (soft[i * 2 + 1] << 8) + soft[i * 2];
-      v->distances[j] = v->dist_table[j][idx];
+      v->distances[j] = v->dist_table[v->perm[j]][idx];
     }
     history = &(v->history[v->hist_index][0]);
 
@@ -405,7 +405,7 @@ static void Vit_Tail(viterbi27_rec_t *v, uint8_t *soft) {
     for( j = 0; j <= 3; j++ )
     {
       int idx = (soft[i * 2 + 1] << 8) + soft[i * 2];
-      v->distances[j] = v->dist_table[j][idx];
+      v->distances[j] = v->dist_table[v->perm[j]][idx];
     }
     history = &(v->history[v->hist_index][0]);
 
@@ -486,31 +486,43 @@ static void Vit_Conv_Encode(
         uint8_t *input,
         uint8_t *output) {
   uint32_t sh;
+  uint8_t hard;
   int i;
-  bit_io_rec_t b;
+  bit_reader_rec_t b;
 
-  b.p = input;
-  b.pos = 0;
+  Bitop_ReaderCreate( &b, input, FRAME_BITS / 8 );
 
   sh = 0;
   for( i = 0; i < FRAME_BITS; i++ )
   {
+    if( (i & 31) == 0 ) Bitop_Refill( &b );
     sh = ( (sh << 1) | Bitop_FetchNBits(&b, 1) ) & 0x7F;
+    hard = v->perm[ v->table[sh] ];
 
-    if( (v->table[sh] & 1) != 0 ) output[i * 2 + 0] = 0;
+    if( (hard & 1) != 0 ) output[i * 2 + 0] = 0;
     else output[i * 2 + 0] = 255;
 
-    if( (v->table[sh] & 2) != 0 ) output[i * 2 + 1] = 0;
+    if( (hard & 2) != 0 ) output[i * 2 + 1] = 0;
     else output[i * 2 + 1] = 255;
   }
 }
 
 /*****************************************************************************/
 
-void Vit_Decode(viterbi27_rec_t *v, uint8_t *input, uint8_t *output) {
+/* Vit_Decode()
+ *
+ * Decodes a frame of soft symbols as received with the given
+ * IQ rotation/flip (sync pattern number) and gauges its BER
+ */
+void Vit_Decode(
+        viterbi27_rec_t *v,
+        uint8_t *input,
+        uint8_t *output,
+        int shift) {
   int i;
   uint8_t corrected[FRAME_BITS * 2];
 
+  v->perm = iq_hard_perm[shift];
   Vit_Conv_Decode( v, output, input );
 
   //Gauge error level
@@ -527,6 +539,7 @@ void Mk_Viterbi27(viterbi27_rec_t *v) {
 
   v->BER = 0;
   v->pair_distances = NULL; // My addition, for alloc's
+  v->perm = iq_hard_perm[0];
 
   // Metric lookup table
   for( i = 0; i <= 3; i++ )
@@ -39,6 +39,7 @@ typedef struct viterbi27_rec_t {
 
   uint16_t dist_table[4][65536];
   uint8_t  table[NUM_STATES];
+  const uint8_t *perm;          // Hard symbol permutation of the frame
   uint16_t distances[4];
 
   bit_io_rec_t bit_writer;
@@ -67,7 +68,7 @@ static inline double Vit_Get_Percent_BER(const viterbi27_rec_t *v) {
 
 /*****************************************************************************/
 
-void Vit_Decode(viterbi27_rec_t *v, uint8_t *input, uint8_t *output);
+void Vit_Decode(viterbi27_rec_t *v, uint8_t *input, uint8_t *output, int shift);
 void Mk_Viterbi27(viterbi27_rec_t *v);
 
 /*****************************************************************************/
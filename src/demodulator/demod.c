@@ -29,6 +29,7 @@
 #include "doqpsk.h"
 #include "filters.h"
 #include "pll.h"
+#include "soft_ring.h"
 
 #include <complex.h>
 #include <math.h>
@@ -52,10 +53,8 @@
 #define RESYNC_SCALE_DOQPSK     2000000.0
 #define RESYNC_SCALE_IDOQPSK    2000000.0
 
-/* TODO seems like mess-up; recheck and refer to SOFT_FRAME_LENGTH directly */
-#define DEMOD_BUF_SIZE  49152 // 3 * SOFT_FRAME_LEN
-#define DEMOD_BUF_MIDL  16384 // 1 * SOFT_FRAME_LEN
-#define DEMOD_BUF_LOWR  32768 // 2 * SOFT_FRAME_LEN
+/* Length of the soft symbols ring, in frames */
+#define SOFT_RING_LEN   (4 * SOFT_FRAME_LEN)
 /* TODO refer directly */
 #define RAW_BUF_REALLOC 73728 // INTLV_BASE_LEN
 
@@ -111,9 +110,6 @@ static bool Demod_QPSK(complex double fdata, int8_t *buffer) {
 
   static int buf_idx = 0;
 
-  int8_t *buf_lowr = buffer + DEMOD_BUF_LOWR;
-  int8_t *buf_midl = buffer + DEMOD_BUF_MIDL;
-
 
   /* Static values initialization */
   if( sym_period == 0.0 )
@@ -144,15 +140,12 @@ static bool Demod_QPSK(complex double fdata, int8_t *buffer) {
     resync_offset += 1.0;
 
     /* Save result in demod buffer */
-    buf_lowr[buf_idx++] = Clamp_Int8( creal(current) / 2.0 );
-    buf_lowr[buf_idx++] = Clamp_Int8( cimag(current) / 2.0 );
+    buffer[buf_idx++] = Clamp_Int8( creal(current) / 2.0 );
+    buffer[buf_idx++] = Clamp_Int8( cimag(current) / 2.0 );
 
-    /* Copy symbols in the local buffer to
-     * the Demodulator buffer and return */
+    /* Return when the frame in the ring is complete */
     if( buf_idx >= SOFT_FRAME_LEN )
     {
-      /* Move the 2 lower parts of Demodulator buffer to the top */
-      memmove( buffer, buf_midl, DEMOD_BUF_LOWR );
       buf_idx = 0;
       return true;
     }
@@ -188,9 +181,6 @@ static bool Demod_DOQPSK(complex double fdata, int8_t *buffer) {
   double resync_error, delta;
   static int buf_idx = 0;
 
-  int8_t *buf_lowr = buffer + DEMOD_BUF_LOWR;
-  int8_t *buf_midl = buffer + DEMOD_BUF_MIDL;
-
 
   /* Static values initialization */
   if( sym_period != demodulator->sym_period )
@@ -228,16 +218,13 @@ static bool Demod_DOQPSK(complex double fdata, int8_t *buffer) {
     resync_offset += 1.0;
 
     /* Save result in demod buffer */
-    buf_lowr[buf_idx++] = Clamp_Int8( creal(current) / 2.0 );
-    buf_lowr[buf_idx++] = Clamp_Int8( cimag(current) / 2.0 );
+    buffer[buf_idx++] = Clamp_Int8( creal(current) / 2.0 );
+    buffer[buf_idx++] = Clamp_Int8( cimag(current) / 2.0 );
 
-    /* Copy symbols in the local buffer to
-     * the Demodulator buffer and return */
+    /* Return when the frame in the ring is complete */
     if( buf_idx >= SOFT_FRAME_LEN )
     {
-      /* Move the 2 lower parts of Demodulator buffer to the top */
-      De_Diffcode( buf_lowr, SOFT_FRAME_LEN );
-      memmove( buffer, buf_midl, DEMOD_BUF_LOWR );
+      De_Diffcode( buffer, SOFT_FRAME_LEN );
       buf_idx = 0;
       return true;
     }
@@ -278,8 +265,6 @@ static bool Demod_IDOQPSK(complex double fdata, int8_t *demod_buf) {
   static uint8_t *resync_buf = NULL;
   static int resync_siz = 0, resync_idx = 0, copy_siz = 0;
 
-  int8_t *demod_buf_lowr = demod_buf + DEMOD_BUF_LOWR;
-  int8_t *demod_buf_midl = demod_buf + DEMOD_BUF_MIDL;
   static int demod_buf_idx = 0;
 
   static bool deint_done = false;
@@ -355,7 +340,7 @@ static bool Demod_IDOQPSK(complex double fdata, int8_t *demod_buf) {
     copy_siz = SOFT_FRAME_LEN - demod_buf_idx;
     if( copy_siz > resync_siz ) copy_siz = resync_siz;
     memcpy(
-        demod_buf_lowr + demod_buf_idx,
+        demod_buf      + demod_buf_idx,
         resync_buf     + resync_idx,
         (size_t)copy_siz );
     demod_buf_idx += copy_siz;
@@ -363,15 +348,11 @@ static bool Demod_IDOQPSK(complex double fdata, int8_t *demod_buf) {
     resync_idx    += copy_siz;
   }
 
-  /* Copy symbols in the local buffer to
-   * the Demodulator buffer and return */
+  /* Return when the frame in the ring is complete */
   if( demod_buf_idx >= SOFT_FRAME_LEN )
   {
     /* Undo differential modulation */
-    De_Diffcode( demod_buf_lowr, SOFT_FRAME_LEN );
-
-    /* Move the 2 lower parts of Demodulator buffer to the top */
-    memmove( demod_buf, demod_buf_midl, DEMOD_BUF_LOWR );
+    De_Diffcode( demod_buf, SOFT_FRAME_LEN );
     demod_buf_idx = 0;
     return true;
   }
@@ -437,7 +418,6 @@ void Demod_Init(void) {
 
   ClearFlag( IMAGES_PROCESSED );
   ClearFlag( IMAGES_RECTIFIED );
-  ClearFlag( IMAGE_COLORIZED );  
 }
 
 /*****************************************************************************/
@@ -513,7 +493,7 @@ double Pll_Average(void) {
 bool Demodulator_Run(void) {
   uint32_t count, done, idx, buf_idx;
   complex double  cdata, fdata;
-  static int8_t  *out_buffer = NULL;
+  static Soft_Ring_t *soft_ring = NULL;
   uint32_t fft_decim_cnt, data_idx;
   double sum_i, sum_q;
 
@@ -521,7 +501,7 @@ bool Demodulator_Run(void) {
   if( isFlagClear(STATUS_RECEIVING) )
   {
     Mj_Dump_Image();
-    free_ptr( (void **)&out_buffer );
+    Soft_Ring_Free( &soft_ring );
     ClearFlag( STATUS_DEMODULATING );
 
     /* Will de-initialize systems and free
@@ -536,13 +516,12 @@ bool Demodulator_Run(void) {
     return false;
   }
 
-  /* Allocate output buffer on first call. It is 3 sections
-   * of SOFT_FRAME_LEN size, top and middle sections are used
-   * by the image decoder and the lower for saving new data */
-  if( !out_buffer )
+  /* Create the soft symbols ring on first call. The demodulator
+   * fills it a frame at a time and the image decoder reads it */
+  if( !soft_ring )
   {
     SetFlag( STATUS_DEMODULATING );
-    mem_alloc( (void **)&out_buffer, 3 * SOFT_FRAME_LEN );
+    soft_ring = Soft_Ring_Init( SOFT_RING_LEN );
   }
 
   /* Wait on DSP data to be ready for processing */
@@ -593,21 +572,17 @@ bool Demodulator_Run(void) {
       /* Pass samples through interpolator RRC filter */
       fdata = Filter_Fwd( demodulator->rrc, cdata );
 
-      /* Demodulate using appropriate function (QPSK|DOQPSK|IDOQPSK).
-       * Try to decode one or more LRPT frames when PLL is locked */
-      if( Demod_PSK(fdata, out_buffer) &&
-          demodulator->costas->locked  &&
-          isFlagSet(STATUS_DECODING) )
+      /* Demodulate using appropriate function (QPSK|DOQPSK|IDOQPSK)
+       * into the next frame of the soft symbols ring */
+      if( Demod_PSK(fdata,
+            (int8_t *)Soft_Ring_At(soft_ring, soft_ring->write_pos)) )
       {
-        /* Try to decode one or more LRPT frames */
-        Decode_Image( (uint8_t *)out_buffer, SOFT_FRAME_LEN );
+        soft_ring->write_pos += SOFT_FRAME_LEN;
 
-        /* The mtd_record.pos and mtd_record.prev_pos pointers must be
-         * decrimented to point back to the same data in the soft buffer */
-        mtd_record.pos      -= SOFT_FRAME_LEN;
-        mtd_record.prev_pos -= SOFT_FRAME_LEN;
-
-      } /* if( demodulator->costas->locked ... ) */
+        /* Try to decode one or more LRPT frames when PLL is locked */
+        if( demodulator->costas->locked && isFlagSet(STATUS_DECODING) )
+          Decode_Image( soft_ring );
+      }
     } /* for( idx = 0; idx < rc_data.interp_mult; idx++ ) */
 
     count++;
@@ -616,7 +591,8 @@ bool Demodulator_Run(void) {
   if( isFlagSet(STATUS_RECEIVING) )
   {
     /* Display the QPSK constellation */
-    Display_QPSK_Const( out_buffer );
+    Display_QPSK_Const( (int8_t *)Soft_Ring_At(
+          soft_ring, soft_ring->write_pos - SOFT_FRAME_LEN) );
 
     /* Display Demodulator params (AGC gain, PLL freq etc) */
     Display_Demod_Params( demodulator );
@@ -0,0 +1,101 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 3 of
+ *  the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details:
+ *
+ *  http://www.gnu.org/copyleft/gpl.txt
+ */
+
+
+/*****************************************************************************/
+
+/* memfd_create() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "soft_ring.h"
+
+#include "../glrpt/utils.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*****************************************************************************/
+
+static void Soft_Ring_Error(const char *msg);
+
+/*****************************************************************************/
+
+/* Soft_Ring_Error()
+ *
+ * Reports a failure to map the ring and exits, like mem_alloc()
+ */
+static void Soft_Ring_Error(const char *msg) {
+  perror( msg );
+  exit( -1 );
+}
+
+/*****************************************************************************/
+
+/* Soft_Ring_Init()
+ *
+ * Creates a soft symbols ring of len bytes, which must be a power
+ * of 2 and a multiple of the page size. An anonymous memory file is
+ * mapped twice into a reserved region of twice its length
+ */
+Soft_Ring_t *Soft_Ring_Init(int len) {
+  Soft_Ring_t *ring = NULL;
+  uint8_t *base;
+  int fd;
+
+  mem_alloc( (void **)&ring, sizeof(*ring) );
+  ring->len = len;
+  ring->write_pos = 0;
+
+  fd = memfd_create( "glrpt-soft-ring", MFD_CLOEXEC );
+  if( fd < 0 )
+    Soft_Ring_Error( "glrpt: memfd_create() for soft ring failed" );
+  if( ftruncate(fd, len) < 0 )
+    Soft_Ring_Error( "glrpt: ftruncate() of soft ring failed" );
+
+  /* Reserve address space for both mappings */
+  base = mmap( NULL, 2 * (size_t)len, PROT_NONE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+  if( base == MAP_FAILED )
+    Soft_Ring_Error( "glrpt: mmap() of soft ring failed" );
+
+  if( (mmap(base, (size_t)len, PROT_READ | PROT_WRITE,
+          MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) ||
+      (mmap(base + len, (size_t)len, PROT_READ | PROT_WRITE,
+          MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) )
+    Soft_Ring_Error( "glrpt: mmap() of soft ring failed" );
+
+  /* The mappings keep the memory file alive */
+  close( fd );
+
+  ring->buf = base;
+  return( ring );
+}
+
+/*****************************************************************************/
+
+/* Soft_Ring_Free()
+ *
+ * Unmaps a soft symbols ring and frees it
+ */
+void Soft_Ring_Free(Soft_Ring_t **ring) {
+  if( *ring == NULL ) return;
+
+  munmap( (*ring)->buf, 2 * (size_t)(*ring)->len );
+  free_ptr( (void **)ring );
+}
@@ -0,0 +1,56 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License as
+ *  published by the Free Software Foundation; either version 3 of
+ *  the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details:
+ *
+ *  http://www.gnu.org/copyleft/gpl.txt
+ */
+
+
+/*****************************************************************************/
+
+#ifndef DEMODULATOR_SOFT_RING_H
+#define DEMODULATOR_SOFT_RING_H
+
+/*****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*****************************************************************************/
+
+/* Ring buffer of soft symbols, mapped twice back to back in memory
+ * so that any window of up to its length can be read contiguously.
+ * Positions in the stream grow monotonically, 64 bit so they never
+ * overflow in a session, and are wrapped only when converted to a
+ * pointer */
+typedef struct Soft_Ring_t {
+    uint8_t *buf;       /* Start of the first of the two mappings  */
+    int      len;       /* Length of the ring, a power of 2        */
+    int64_t  write_pos; /* Stream position of the next write chunk */
+} Soft_Ring_t;
+
+/*****************************************************************************/
+
+/* Soft_Ring_At()
+ *
+ * Returns a pointer to the soft symbol at stream position pos
+ */
+static inline uint8_t *Soft_Ring_At(const Soft_Ring_t *ring, int64_t pos) {
+    return ring->buf + (size_t)(pos & (int64_t)(ring->len - 1));
+}
+
+/*****************************************************************************/
+
+Soft_Ring_t *Soft_Ring_Init(int len);
+void Soft_Ring_Free(Soft_Ring_t **ring);
+
+/*****************************************************************************/
+
+#endif
@@ -8,9 +8,12 @@
  * The main routine (CLAHE) expects an input image that is stored contiguously
  * in memory;  the CLAHE output image overwrites the original input image and
  * has the same minimum and maximum values (which must be provided by the user).
- * This implementation assumes that the X- and Y image resolutions are an integer
- * multiple of the X- and Y sizes of the contextual regions. A check on various
- * other error conditions is performed.
+ * If the X- or Y image resolution is not an integer multiple of the number of
+ * contextual regions, the image is taken as padded to one by replicating its
+ * last column and row. A check on various other error conditions is performed.
+ *
+ * Changed for glrpt to use 32 bit histograms and to map the regions and
+ * interpolate strips of rows in parallel on the thread pool.
  *
  * The maximum number of contextual regions can be redefined
  * by changing MAX_REG_X and/or MAX_REG_Y; the use of more than 256
@@ -26,6 +29,8 @@
 
 #include "clahe.h"
 
+#include "../common/shared.h"
+#include "../common/thread_pool.h"
 #include "utils.h"
 
 #include <stdbool.h>
@@ -40,26 +45,47 @@
 #define MAX_REG_X   16
 #define MAX_REG_Y   16
 
+/* Fewest pixels in a strip of rows interpolated by a worker thread */
+#define STRIP_MIN_PIXELS    65536
+
+/*****************************************************************************/
+
+/* Arguments of the region and strip jobs of CLAHE() */
+typedef struct clahe_job_t {
+    kz_pixel_t *pImage;
+    uint32_t uiXRes, uiYRes;
+    uint32_t uiXSize, uiYSize;      /* Size of the (padded) regions */
+    uint32_t uiNrX, uiNrY;
+    uint32_t uiNrBins;
+    uint32_t uiClipLimit;
+    kz_pixel_t Min, Max;
+    uint32_t *puiMapArray;          /* Mappings of all the regions  */
+    int strips;
+    kz_pixel_t aLUT[uiNR_OF_GREY];  /* Grey values to bins          */
+} clahe_job_t;
+
 /*****************************************************************************/
 
 static void ClipHistogram(
-        unsigned long *pulHistogram,
+        uint32_t *puiHistogram,
         uint32_t uiNrGreylevels,
-        unsigned long ulClipLimit);
+        uint32_t uiClipLimit);
 static void MakeHistogram(
         kz_pixel_t *pImage,
         uint32_t uiXRes,
         uint32_t uiSizeX,
         uint32_t uiSizeY,
-        unsigned long *pulHistogram,
+        uint32_t uiPadX,
+        uint32_t uiPadY,
+        uint32_t *puiHistogram,
         uint32_t uiNrGreylevels,
         kz_pixel_t *pLookupTable);
 static void MapHistogram(
-        unsigned long *pulHistogram,
+        uint32_t *puiHistogram,
         kz_pixel_t Min,
         kz_pixel_t Max,
         uint32_t uiNrGreylevels,
-        unsigned long ulNrOfPixels);
+        uint32_t uiNrOfPixels);
 static void MakeLut(
         kz_pixel_t *pLUT,
         kz_pixel_t Min,
@@ -67,14 +93,14 @@ static void MakeLut(
         uint32_t uiNrBins);
 static void Interpolate(
         kz_pixel_t *pImage,
-        uint32_t uiXRes,
-        unsigned long *pulMapLU,
-        unsigned long *pulMapRU,
-        unsigned long *pulMapLB,
-        unsigned long *pulMapRB,
-        uint32_t uiXSize,
-        uint32_t uiYSize,
-        kz_pixel_t *pLUT);
+        uint32_t *puiMapU,
+        uint32_t *puiMapB,
+        uint32_t uiYCoef,
+        uint32_t uiYInvCoef,
+        uint32_t uiSubY,
+        const clahe_job_t *job);
+static void Map_Region(void *arg, int idx);
+static void Interpolate_Strip(void *arg, int idx);
 
 /*****************************************************************************/
 
@@ -87,79 +113,76 @@ static void Interpolate(
  * the cliplimit ).
  */
 static void ClipHistogram(
-        unsigned long *pulHistogram,
+        uint32_t *puiHistogram,
         uint32_t uiNrGreylevels,
-        unsigned long ulClipLimit) {
-  unsigned long *pulBinPointer, *pulEndPointer, *pulHisto;
-  unsigned long ulNrExcess, ulUpper, ulBinIncr, ulStepSize, i;
-  long lBinExcess;
+        uint32_t uiClipLimit) {
+  uint32_t *puiBinPointer, *puiEndPointer, *puiHisto;
+  uint32_t uiNrExcess, uiUpper, uiBinIncr, uiStepSize, i;
 
-  ulNrExcess = 0;
-  pulBinPointer = pulHistogram;
+  uiNrExcess = 0;
+  puiBinPointer = puiHistogram;
 
   for( i = 0; i < uiNrGreylevels; i++ )
   {
     /* calculate total number of excess pixels */
-    lBinExcess = (long)pulBinPointer[i] - (long)ulClipLimit;
-
-    /* excess in current bin */
-    if( lBinExcess > 0 ) ulNrExcess += (unsigned long)lBinExcess;
+    if( puiBinPointer[i] > uiClipLimit )
+      uiNrExcess += puiBinPointer[i] - uiClipLimit;
   }
 
   /* Second part: clip histogram and
    * redistribute excess pixels in each bin */
 
   /* average binincrement */
-  ulBinIncr = ulNrExcess / uiNrGreylevels;
+  uiBinIncr = uiNrExcess / uiNrGreylevels;
 
-  /* Bins larger than ulUpper set to cliplimit */
-  ulUpper =  ulClipLimit - ulBinIncr;
+  /* Bins larger than uiUpper set to cliplimit */
+  uiUpper =  uiClipLimit - uiBinIncr;
 
   for( i = 0; i < uiNrGreylevels; i++ )
   {
-    if( pulHistogram[i] > ulClipLimit )
-      pulHistogram[i] = ulClipLimit; /* clip bin */
+    if( puiHistogram[i] > uiClipLimit )
+      puiHistogram[i] = uiClipLimit; /* clip bin */
     else
     {
-      if( pulHistogram[i] > ulUpper )
+      if( puiHistogram[i] > uiUpper )
       {
         /* high bin count */
-        ulNrExcess -= pulHistogram[i] - ulUpper;
-        pulHistogram[i] = ulClipLimit;
+        uiNrExcess -= puiHistogram[i] - uiUpper;
+        puiHistogram[i] = uiClipLimit;
       }
       else
       {
         /* low bin count */
-        ulNrExcess -= ulBinIncr;
-        pulHistogram[i] += ulBinIncr;
+        uiNrExcess -= uiBinIncr;
+        puiHistogram[i] += uiBinIncr;
       }
     }
   }
 
-  while( ulNrExcess )
+  while( uiNrExcess )
   {
     /* Redistribute remaining excess  */
-    pulEndPointer = &pulHistogram[uiNrGreylevels];
-    pulHisto = pulHistogram;
+    puiEndPointer = &puiHistogram[uiNrGreylevels];
+    puiHisto = puiHistogram;
 
-    while( ulNrExcess && (pulHisto < pulEndPointer) )
+    while( uiNrExcess && (puiHisto < puiEndPointer) )
     {
-      ulStepSize = uiNrGreylevels / ulNrExcess;
-      if( ulStepSize < 1 ) ulStepSize = 1;  /* stepsize at least 1 */
+      uiStepSize = uiNrGreylevels / uiNrExcess;
+      if( uiStepSize < 1 ) uiStepSize = 1;  /* stepsize at least 1 */
       for(
-          pulBinPointer = pulHisto;
-          (pulBinPointer < pulEndPointer) && ulNrExcess;
-          pulBinPointer += ulStepSize )
+          puiBinPointer = puiHisto;
+          (puiBinPointer < puiEndPointer) && uiNrExcess;
+          puiBinPointer += uiStepSize )
       {
-        if( *pulBinPointer < ulClipLimit )
+        if( *puiBinPointer < uiClipLimit )
         {
-          ( *pulBinPointer )++;
-          ulNrExcess--;   /* reduce excess */
+          ( *puiBinPointer )++;
+          uiNrExcess--;   /* reduce excess */
         }
       }
 
       /* restart redistributing on other bin location */
-      pulHisto++;
+      puiHisto++;
     }
   }
 }
@@ -172,31 +195,40 @@ static void ClipHistogram(
  * a greylevel histogram. The pLookupTable specifies the relationship
  * between the greyvalue of the pixel (typically between 0 and 4095) and
  * the corresponding bin in the histogram (usually containing only 128 bins).
+ * The last column and row of the region are counted uiPadX and uiPadY
+ * more times, for regions that extend past the edges of the image.
  */
 static void MakeHistogram(
         kz_pixel_t *pImage,
         uint32_t uiXRes,
         uint32_t uiSizeX,
         uint32_t uiSizeY,
-        unsigned long *pulHistogram,
+        uint32_t uiPadX,
+        uint32_t uiPadY,
+        uint32_t *puiHistogram,
         uint32_t uiNrGreylevels,
         kz_pixel_t *pLookupTable) {
-  kz_pixel_t *pImagePointer;
-  uint32_t i;
+  kz_pixel_t *pRow, *pEnd;
+  uint32_t i, uiTimes;
 
   /* clear histogram */
   for( i = 0; i < uiNrGreylevels; i++ )
-    pulHistogram[i] = 0L;
+    puiHistogram[i] = 0;
 
   for( i = 0; i < uiSizeY; i++ )
   {
-    pImagePointer = &pImage[uiSizeX];
-    while( pImage < pImagePointer )
-      pulHistogram[ pLookupTable[ *pImage++ ] ]++;
-    pImagePointer += uiXRes;
+    pRow = &pImage[(size_t)i * uiXRes];
+    pEnd = &pRow[uiSizeX];
 
-    /* go to bdeginning of next row */
-    pImage = &pImagePointer[ -(int)uiSizeX ];
+    /* the last row stands in for the padding rows */
+    uiTimes = ( i == uiSizeY - 1 ) ? uiPadY + 1 : 1;
+    while( uiTimes-- )
+    {
+      kz_pixel_t *pPixel = pRow;
+      while( pPixel < pEnd )
+        puiHistogram[ pLookupTable[ *pPixel++ ] ]++;
+      puiHistogram[ pLookupTable[ pEnd[-1] ] ] += uiPadX;
+    }
   }
 }
 
@@ -209,21 +241,21 @@ static void MakeHistogram(
  * lookup table is rescaled in range [Min..Max].
  */
 static void MapHistogram(
-        unsigned long *pulHistogram,
+        uint32_t *puiHistogram,
         kz_pixel_t Min,
         kz_pixel_t Max,
         uint32_t uiNrGreylevels,
-        unsigned long ulNrOfPixels) {
+        uint32_t uiNrOfPixels) {
   uint32_t i;
-  unsigned long ulSum = 0;
-  const float fScale = ( (float)(Max - Min) ) / ulNrOfPixels;
-  const unsigned long ulMin = (unsigned long)Min;
+  uint32_t uiSum = 0;
+  const float fScale = ( (float)(Max - Min) ) / uiNrOfPixels;
+  const uint32_t uiMin = (uint32_t)Min;
 
   for( i = 0; i < uiNrGreylevels; i++ )
   {
-    ulSum += pulHistogram[i];
-    pulHistogram[i] = (unsigned long)( ulMin + ulSum * fScale );
-    if( pulHistogram[i] > Max ) pulHistogram[i] = Max;
+    uiSum += puiHistogram[i];
+    puiHistogram[i] = (uint32_t)( uiMin + uiSum * fScale );
+    if( puiHistogram[i] > Max ) puiHistogram[i] = Max;
   }
 }
 
@@ -250,85 +282,188 @@ static void MakeLut(
 
 /* Interpolate()
  *
- * This function calculates the new greylevel assignments of pixels within a submatrix
- * of the image with size uiXSize and uiYSize. This is done by a bilinear interpolation
- * between four different mappings in order to eliminate boundary artifacts.
- * It uses a division; since division is often an expensive operation, I added code to
- * perform a logical shift instead when feasible.
- *
- * pImage      - pointer to input/output image
- * uiXRes      - resolution of image in x-direction
- * pulMap*     - mappings of greylevels from histograms
- * uiXSize     - uiXSize of image submatrix
- * uiYSize     - uiYSize of image submatrix
- * pLUT        - lookup table containing mapping greyvalues to bins
+ * This function calculates the new greylevel assignments of the pixels of
+ * an image row, by a bilinear interpolation between the mappings of the
+ * four contextual regions around each pixel, in order to eliminate boundary
+ * artifacts. The row lies uiYCoef rows into a band of uiSubY rows between
+ * the regions mapped by puiMapU (above) and puiMapB (below), and is split
+ * into column bands the same way. Pixels past the right edge of the image
+ * are skipped. It uses a division; since division is often an expensive
+ * operation, a logical shift is used instead when feasible.
  */
 static void Interpolate(
         kz_pixel_t *pImage,
-        uint32_t uiXRes,
-        unsigned long *pulMapLU,
-        unsigned long *pulMapRU,
-        unsigned long *pulMapLB,
-        unsigned long *pulMapRB,
-        uint32_t uiXSize,
-        uint32_t uiYSize,
-        kz_pixel_t *pLUT) {
-  /* Pointer increment after processing row */
-  const uint32_t uiIncr = uiXRes - uiXSize;
-
-  /* Normalization factor */
+        uint32_t *puiMapU,
+        uint32_t *puiMapB,
+        uint32_t uiYCoef,
+        uint32_t uiYInvCoef,
+        uint32_t uiSubY,
+        const clahe_job_t *job) {
+  uint32_t *puiMapLU, *puiMapRU, *puiMapLB, *puiMapRB;
+  uint32_t uiX, uiXL, uiXR, uiSubX, uiWidth, uiXPos = 0;
+  uint32_t uiXCoef, uiXInvCoef, uiNum, uiShift, uiVal;
   kz_pixel_t GreyValue;
-  uint32_t uiNum = uiXSize*uiYSize;
-
-  uint32_t uiXCoef, uiYCoef, uiXInvCoef, uiYInvCoef, uiShift = 0;
 
-  /* If uiNum is not a power of two, use division */
-  if( uiNum & (uiNum - 1) )
+  for( uiX = 0; (uiX <= job->uiNrX) && (uiXPos < job->uiXRes); uiX++ )
   {
+    if( uiX == 0 )
+    {
+      /* special case: left column */
+      uiSubX = job->uiXSize >> 1;
+      uiXL   = 0;
+      uiXR   = 0;
+    }
+    else if( uiX == job->uiNrX )
+    {
+      /* special case: right column */
+      uiSubX = ( job->uiXSize + 1 ) >> 1;
+      uiXL   = job->uiNrX - 1;
+      uiXR   = uiXL;
+    }
+    else
+    {
+      /* default values */
+      uiSubX = job->uiXSize;
+      uiXL   = uiX  - 1;
+      uiXR   = uiXL + 1;
+    }
+
+    puiMapLU = &puiMapU[job->uiNrBins * uiXL];
+    puiMapRU = &puiMapU[job->uiNrBins * uiXR];
+    puiMapLB = &puiMapB[job->uiNrBins * uiXL];
+    puiMapRB = &puiMapB[job->uiNrBins * uiXR];
+
+    /* Clip the band at the edge of the image */
+    uiNum   = uiSubX * uiSubY;
+    uiWidth = uiSubX;
+    if( uiWidth > job->uiXRes - uiXPos )
+      uiWidth = job->uiXRes - uiXPos;
+
+    /* If uiNum is a power of two, avoid the division */
+    uiShift = 0;
+    if( !(uiNum & (uiNum - 1)) )
+      while( (1u << uiShift) < uiNum ) uiShift++;
+
     for(
-        uiYCoef = 0, uiYInvCoef = uiYSize;
-        uiYCoef < uiYSize;
-        uiYCoef++, uiYInvCoef--, pImage += uiIncr )
+        uiXCoef = 0, uiXInvCoef = uiSubX;
+        uiXCoef < uiWidth;
+        uiXCoef++, uiXInvCoef-- )
     {
-      for(
-          uiXCoef = 0, uiXInvCoef = uiXSize;
-          uiXCoef < uiXSize;
-          uiXCoef++, uiXInvCoef-- )
-      {
-        GreyValue = pLUT[ *pImage ];  /* get histogram bin value */
-        *pImage++ = (kz_pixel_t)
-          ( (uiYInvCoef *
-             (uiXInvCoef * pulMapLU[GreyValue] + uiXCoef * pulMapRU[GreyValue]) +
-             uiYCoef *
-             (uiXInvCoef * pulMapLB[GreyValue] + uiXCoef * pulMapRB[GreyValue])) /
-            uiNum );
-      }
+      GreyValue = job->aLUT[ *pImage ];  /* get histogram bin value */
+      uiVal =
+        uiYInvCoef *
+        (uiXInvCoef * puiMapLU[GreyValue] + uiXCoef * puiMapRU[GreyValue]) +
+        uiYCoef *
+        (uiXInvCoef * puiMapLB[GreyValue] + uiXCoef * puiMapRB[GreyValue]);
+      *pImage++ = (kz_pixel_t)( uiShift ? uiVal >> uiShift : uiVal / uiNum );
     }
+
+    uiXPos += uiWidth;
   }
-  else
+}
+
+/*****************************************************************************/
+
+/* Map_Region()
+ *
+ * Worker thread job, makes the clipped and equalized
+ * greylevel mapping of contextual region idx
+ */
+static void Map_Region(void *arg, int idx) {
+  clahe_job_t *job = (clahe_job_t *)arg;
+  uint32_t uiX = (uint32_t)idx % job->uiNrX;
+  uint32_t uiY = (uint32_t)idx / job->uiNrX;
+  uint32_t uiX0 = uiX * job->uiXSize, uiY0 = uiY * job->uiYSize;
+  uint32_t uiSizeX = job->uiXSize, uiSizeY = job->uiYSize;
+  uint32_t uiPadX = 0, uiPadY = 0;
+  uint32_t *puiHist = &job->puiMapArray[job->uiNrBins * (uint32_t)idx];
+
+  /* Regions past the edges are padded with the last column or row */
+  if( uiX0 >= job->uiXRes )
   {
-    /* avoid the division and use a right shift instead */
-    while( uiNum >>= 1 ) uiShift++; /* Calculate 2log of uiNum */
+    uiX0    = job->uiXRes - 1;
+    uiSizeX = 1;
+    uiPadX  = job->uiXSize - 1;
+  }
+  else if( uiX0 + uiSizeX > job->uiXRes )
+  {
+    uiPadX  = uiX0 + uiSizeX - job->uiXRes;
+    uiSizeX = job->uiXRes - uiX0;
+  }
 
-    for(
-        uiYCoef = 0, uiYInvCoef = uiYSize;
-        uiYCoef < uiYSize;
-        uiYCoef++, uiYInvCoef--, pImage += uiIncr )
+  if( uiY0 >= job->uiYRes )
+  {
+    uiY0    = job->uiYRes - 1;
+    uiSizeY = 1;
+    uiPadY  = job->uiYSize - 1;
+  }
+  else if( uiY0 + uiSizeY > job->uiYRes )
+  {
+    uiPadY  = uiY0 + uiSizeY - job->uiYRes;
+    uiSizeY = job->uiYRes - uiY0;
+  }
+
+  MakeHistogram(
+      &job->pImage[(size_t)uiY0 * job->uiXRes + uiX0], job->uiXRes,
+      uiSizeX, uiSizeY, uiPadX, uiPadY,
+      puiHist, job->uiNrBins, job->aLUT );
+  ClipHistogram( puiHist, job->uiNrBins, job->uiClipLimit );
+  MapHistogram( puiHist, job->Min, job->Max, job->uiNrBins,
+      job->uiXSize * job->uiYSize );
+}
+
+/*****************************************************************************/
+
+/* Interpolate_Strip()
+ *
+ * Worker thread job, interpolates the greylevel
+ * mappings of the rows of strip idx of the image
+ */
+static void Interpolate_Strip(void *arg, int idx) {
+  clahe_job_t *job = (clahe_job_t *)arg;
+  uint32_t uiRow, uiEnd, uiBand, uiHalf;
+  uint32_t uiSubY, uiYU, uiYB, uiYCoef;
+
+  uiRow = (uint32_t)( (uint64_t)job->uiYRes * (uint32_t)idx / (uint32_t)job->strips );
+  uiEnd = (uint32_t)( (uint64_t)job->uiYRes * (uint32_t)(idx + 1) / (uint32_t)job->strips );
+  uiHalf = job->uiYSize >> 1;
+
+  for( ; uiRow < uiEnd; uiRow++ )
+  {
+    if( uiRow < uiHalf )
     {
-      for(
-          uiXCoef = 0, uiXInvCoef = uiXSize;
-          uiXCoef < uiXSize;
-          uiXCoef++, uiXInvCoef-- )
+      /* special case: top row */
+      uiSubY  = uiHalf;
+      uiYU    = 0;
+      uiYB    = 0;
+      uiYCoef = uiRow;
+    }
+    else
+    {
+      uiBand = ( uiRow - uiHalf ) / job->uiYSize;
+      if( uiBand >= job->uiNrY - 1 )
+      {
+        /* special case: bottom row */
+        uiSubY  = ( job->uiYSize + 1 ) >> 1;
+        uiYU    = job->uiNrY - 1;
+        uiYB    = uiYU;
+        uiYCoef = uiRow - uiHalf - uiYU * job->uiYSize;
+      }
+      else
       {
-        GreyValue = pLUT[*pImage]; /* get histogram bin value */
-        *pImage++ = (kz_pixel_t)
-          ( (uiYInvCoef *
-             (uiXInvCoef * pulMapLU[GreyValue] + uiXCoef * pulMapRU[GreyValue]) +
-             uiYCoef *
-             (uiXInvCoef * pulMapLB[GreyValue] + uiXCoef * pulMapRB[GreyValue])) >>
-            uiShift );
+        /* default values */
+        uiSubY  = job->uiYSize;
+        uiYU    = uiBand;
+        uiYB    = uiYU + 1;
+        uiYCoef = uiRow - uiHalf - uiBand * job->uiYSize;
       }
     }
+
+    Interpolate(
+        &job->pImage[(size_t)uiRow * job->uiXRes],
+        &job->puiMapArray[job->uiNrBins * job->uiNrX * uiYU],
+        &job->puiMapArray[job->uiNrBins * job->uiNrX * uiYB],
+        uiYCoef, uiSubY - uiYCoef, uiSubY, job );
   }
 }
 
@@ -340,7 +475,8 @@ static void Interpolate(
  * selecting a small value (eg. 128) speeds up processing and still produce an
  * output image of good quality. The output image will have the same minimum
  * and maximum value as the input image. A clip limit smaller than 1 results
- * in standard (non-contrast limited) AHE.
+ * in standard (non-contrast limited) AHE. The regions are mapped and the
+ * image interpolated on the thread pool, so it must not be called from a job.
  *   pImage - Pointer to the input/output image
  *   uiXRes - Image resolution in the X direction
  *   uiYRes - Image resolution in the Y direction
@@ -361,154 +497,73 @@ bool CLAHE(
         uint32_t uiNrY,
         uint32_t uiNrBins,
         double fCliplimit) {
-  /* counters */
-  uint32_t uiX, uiY;
-
-  /* size of context. reg. and subimages */
-  uint32_t uiXSize, uiYSize, uiSubX, uiSubY;
-
-  /* auxiliary variables interpolation routine */
-  uint32_t uiXL, uiXR, uiYU, uiYB;
-
-  /* clip limit and region pixel count */
-  unsigned long ulClipLimit, ulNrPixels;
-
-  /* pointer to image */
-  kz_pixel_t* pImPointer;
+  clahe_job_t job;
 
-  /* lookup table used for scaling of input image */
-  kz_pixel_t aLUT[uiNR_OF_GREY];
+  /* size of context. reg., rounded up to pad the image */
+  uint32_t uiXSize, uiYSize;
 
   /* pointer to histogram and mappings*/
-  unsigned long *pulHist, *pulMapArray = NULL;
-
-  /* auxiliary pointers interpolation */
-  unsigned long* pulLU, *pulLB, *pulRU, *pulRB;
+  uint32_t *puiMapArray = NULL;
 
   /* Check for error conditions */
   bool error = 0;
   error |= (uiNrX > MAX_REG_X);         /* # of regions x-direction too large */
   error |= (uiNrY > MAX_REG_Y);         /* # of regions y-direction too large */
-  error |= (uiXRes % uiNrX);            /* x-resolution no multiple of uiNrX */
-  error |= (uiYRes % uiNrY);            /* y-resolution no multiple of uiNrY */
-  error |= (Min >= Max);                /* minimum equal or larger than maximum */
   error |= ((uiNrX < 2) || (uiNrY < 2));/* at least 4 contextual regions required */
+  error |= (uiXRes < uiNrX);            /* x-resolution less than uiNrX */
+  error |= (uiYRes < uiNrY);            /* y-resolution less than uiNrY */
+  error |= (Min >= Max);                /* minimum equal or larger than maximum */
   error |= (fCliplimit == 1.0);         /* is OK, immediately returns original image. */
-  
+
   if (error)
       return false;
 
   if( uiNrBins == 0 ) uiNrBins = 128;   /* default value when not specified */
 
-  mem_alloc( (void **)&pulMapArray,
-      sizeof(unsigned long) * uiNrX  *uiNrY * uiNrBins );
-
   /* Actual size of contextual regions */
-  uiXSize = uiXRes / uiNrX;
-  uiYSize = uiYRes / uiNrY;
-  ulNrPixels = (unsigned long)uiXSize * (unsigned long)uiYSize;
+  uiXSize = ( uiXRes + uiNrX - 1 ) / uiNrX;
+  uiYSize = ( uiYRes + uiNrY - 1 ) / uiNrY;
+
+  /* interpolated values must fit the 32 bit mappings */
+  if( (uint64_t)uiXSize * uiYSize * Max > UINT32_MAX )
+    return false;
+
+  mem_alloc( (void **)&puiMapArray,
+      sizeof(uint32_t) * uiNrX * uiNrY * uiNrBins );
+
+  job.pImage   = pImage;
+  job.uiXRes   = uiXRes;
+  job.uiYRes   = uiYRes;
+  job.uiXSize  = uiXSize;
+  job.uiYSize  = uiYSize;
+  job.uiNrX    = uiNrX;
+  job.uiNrY    = uiNrY;
+  job.uiNrBins = uiNrBins;
+  job.Min      = Min;
+  job.Max      = Max;
+  job.puiMapArray = puiMapArray;
 
   if( fCliplimit > 0.0 )
   {
     /* Calculate actual cliplimit */
-    ulClipLimit = (unsigned long)( fCliplimit * (uiXSize * uiYSize) / uiNrBins );
-    ulClipLimit = ( ulClipLimit < 1UL ) ? 1UL : ulClipLimit;
+    job.uiClipLimit = (uint32_t)( fCliplimit * (uiXSize * uiYSize) / uiNrBins );
+    job.uiClipLimit = ( job.uiClipLimit < 1 ) ? 1 : job.uiClipLimit;
   }
-  else ulClipLimit = 1UL << 14; /* Large value, do not clip (AHE) */
+  else job.uiClipLimit = 1u << 14; /* Large value, do not clip (AHE) */
 
   /* Make lookup table for mapping of grey values */
-  MakeLut( aLUT, Min, Max, uiNrBins );
+  MakeLut( job.aLUT, Min, Max, uiNrBins );
 
   /* Calculate greylevel mappings for each contextual region */
-  for( uiY = 0, pImPointer = pImage; uiY < uiNrY; uiY++ )
-  {
-    for( uiX = 0; uiX < uiNrX; uiX++, pImPointer += uiXSize )
-    {
-      pulHist = &pulMapArray[uiNrBins * (uiY * uiNrX + uiX)];
-      MakeHistogram( pImPointer, uiXRes, uiXSize, uiYSize, pulHist, uiNrBins, aLUT );
-      ClipHistogram( pulHist, uiNrBins, ulClipLimit );
-      MapHistogram( pulHist, Min, Max, uiNrBins, ulNrPixels );
-    }
-
-    /* skip lines, set pointer */
-    pImPointer += ( uiYSize - 1 ) * uiXRes;
-  }
+  Pool_For( thread_pool, (int)(uiNrX * uiNrY), Map_Region, &job );
 
   /* Interpolate greylevel mappings to get CLAHE image */
-  for( pImPointer = pImage, uiY = 0; uiY <= uiNrY; uiY++ )
-  {
-    if( uiY == 0 )
-    {
-      /* special case: top row */
-      uiSubY = uiYSize >> 1;
-      uiYU   = 0;
-      uiYB   = 0;
-    }
-    else
-    {
-      if( uiY == uiNrY )
-      {
-        /* special case: bottom row */
-        uiSubY = ( uiYSize + 1 ) >> 1;
-        uiYU   = uiNrY - 1;
-        uiYB   = uiYU;
-      }
-      else
-      {
-        /* default values */
-        uiSubY = uiYSize;
-        uiYU   = uiY  - 1;
-        uiYB   = uiYU + 1;
-      }
-    }
-
-    for( uiX = 0; uiX <= uiNrX; uiX++ )
-    {
-      if( uiX == 0 )
-      {
-        /* special case: left column */
-        uiSubX = uiXSize >> 1;
-        uiXL   = 0;
-        uiXR   = 0;
-      }
-      else
-      {
-        if( uiX == uiNrX )
-        {
-          /* special case: right column */
-          uiSubX = ( uiXSize + 1 ) >> 1;
-          uiXL   = uiNrX - 1;
-          uiXR   = uiXL;
-        }
-        else
-        {
-          /* default values */
-          uiSubX = uiXSize;
-          uiXL   = uiX  - 1;
-          uiXR   = uiXL + 1;
-        }
-      }
-
-      pulLU = &pulMapArray[ uiNrBins * (uiYU * uiNrX + uiXL) ];
-      pulRU = &pulMapArray[ uiNrBins * (uiYU * uiNrX + uiXR) ];
-      pulLB = &pulMapArray[ uiNrBins * (uiYB * uiNrX + uiXL) ];
-      pulRB = &pulMapArray[ uiNrBins * (uiYB * uiNrX + uiXR) ];
-      Interpolate(
-          pImPointer, uiXRes,
-          pulLU,  pulRU,
-          pulLB,  pulRB,
-          uiSubX, uiSubY,
-          aLUT );
-
-      /* set pointer on next matrix */
-      pImPointer += uiSubX;
-    }
-
-    pImPointer += ( uiSubY - 1 ) * uiXRes;
-  }
+  job.strips = Pool_Strips( thread_pool, (int)uiYRes,
+      (int)(STRIP_MIN_PIXELS / uiXRes) );
+  Pool_For( thread_pool, job.strips, Interpolate_Strip, &job );
 
   /* free space for histograms */
-  free_ptr( (void **)&pulMapArray );
+  free_ptr( (void **)&puiMapArray );
 
   /* return status OK */
   return true;
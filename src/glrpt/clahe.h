@@ -24,7 +24,7 @@
 
 /*****************************************************************************/
 
-/* Contextual regions actually used (image size is % 8) */
+/* Contextual regions actually used (image is padded to a multiple) */
 #define REGIONS_X   8
 #define REGIONS_Y   8
 
@@ -18,6 +18,7 @@
 
 #include "../common/common.h"
 #include "../common/shared.h"
+#include "../common/thread_pool.h"
 #include "callback_func.h"
 #include "utils.h"
 
@@ -25,25 +26,234 @@
 #include <gtk/gtk.h>
 #include <glib.h>
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 /*****************************************************************************/
 
 #define BLACK_CUT_OFF   1 /* Black cut-off percentile for normalization */
 #define WHITE_CUT_OFF   1 /* White cut-off percentile for normalization */
 
+/* Shortest interval between updates of the live image, in usec */
+#define DISPLAY_UPDATE_USEC 200000
+
+/* Fewest pixels in a strip of an image processed by a worker thread */
+#define STRIP_MIN_PIXELS    65536
+
+/*****************************************************************************/
+
+/* Histogram banks counted into in turn, so that runs of
+ * equal pixels don't keep incrementing the same counter */
+#define HIST_BANKS  4
+
+/*****************************************************************************/
+
+/* Arguments of the strip jobs of Normalize_Images() */
+typedef struct norm_job_t {
+    uint8_t **images;
+    uint32_t  size;
+    int       strips;                   /* Strips of each image       */
+    uint32_t *hist;                     /* A histogram for each strip */
+    bool      flip;                     /* Also rotate by 180 degrees */
+    bool      skip[CHANNEL_IMAGE_NUM];  /* Images left as they are    */
+    uint8_t   lut[CHANNEL_IMAGE_NUM][MAX_WHITE+1]; /* Normalized values */
+} norm_job_t;
+
+/* Arguments of the strip jobs of Create_Combo_Image() */
+typedef struct combo_job_t {
+    uint8_t       *combo;
+    const uint8_t *red, *green, *blue;
+    uint32_t       size;
+    int            strips;
+    uint8_t lut[CHANNEL_IMAGE_NUM][MAX_WHITE+1]; /* Combo pixel values */
+    uint8_t cloud[MAX_WHITE+1]; /* 0xff for blue channel values of clouds */
+} combo_job_t;
+
+/* Arguments of the strip jobs of Flip_Image() */
+typedef struct flip_job_t {
+    uint8_t  *image;
+    uint32_t  size;
+    int       strips;
+} flip_job_t;
+
+/*****************************************************************************/
+
+static uint32_t Strip_Start(uint32_t len, int strips, int idx);
+static inline uint64_t Lut_Word(const uint8_t *lut, uint64_t in);
+static void Reverse_Strip(
+        uint8_t *image, uint32_t size, uint32_t cnt,
+        uint32_t end, const uint8_t *lut);
+static void Norm_Hist_Strip(void *arg, int idx);
+static void Norm_Lut_Strip(void *arg, int idx);
+static void Flip_Strip(void *arg, int idx);
+static void Combo_Strip(void *arg, int idx);
+
+/*****************************************************************************/
+
+/* Strip_Start()
+ *
+ * Returns the start of strip idx of len items split into strips
+ */
+static uint32_t Strip_Start(uint32_t len, int strips, int idx) {
+  return( (uint32_t)((uint64_t)len * (uint64_t)idx / (uint64_t)strips) );
+}
+
 /*****************************************************************************/
 
-/*  Normalize_Image()
+/* Norm_Hist_Strip()
  *
- *  Does histogram (linear) normalization of a pgm (P5) image file
+ * Builds the intensity histogram of a strip of an image,
+ * strip idx % strips of image idx / strips
  */
-void Normalize_Image(
-        uint8_t *image_buffer,
+static void Norm_Hist_Strip(void *arg, int idx) {
+  norm_job_t *job = (norm_job_t *)arg;
+  const uint8_t *image = job->images[ idx / job->strips ];
+  uint32_t *hist = &job->hist[ idx * (MAX_WHITE+1) ];
+  uint32_t bank[HIST_BANKS][MAX_WHITE+1] = { { 0 } };
+  uint32_t cnt, end;
+  int val;
+
+  cnt = Strip_Start( job->size, job->strips, idx % job->strips );
+  end = Strip_Start( job->size, job->strips, idx % job->strips + 1 );
+  for( ; cnt + HIST_BANKS <= end; cnt += HIST_BANKS )
+  {
+    bank[0][ image[cnt]     ]++;
+    bank[1][ image[cnt + 1] ]++;
+    bank[2][ image[cnt + 2] ]++;
+    bank[3][ image[cnt + 3] ]++;
+  }
+  for( ; cnt < end; cnt++ )
+    bank[0][ image[cnt] ]++;
+
+  for( val = 0; val <= MAX_WHITE; val++ )
+    hist[ val ] = bank[0][val] + bank[1][val] + bank[2][val] + bank[3][val];
+}
+
+/*****************************************************************************/
+
+/* Lut_Word()
+ *
+ * Looks up each of the 8 pixels packed in a 64 bit word
+ */
+static inline uint64_t Lut_Word(const uint8_t *lut, uint64_t in) {
+  uint64_t out = 0;
+  int byte;
+
+  for( byte = 0; byte < (int)sizeof(uint64_t); byte++ )
+    out |= (uint64_t)lut[ (in >> (8 * byte)) & 0xff ] << (8 * byte);
+
+  return( out );
+}
+
+/*****************************************************************************/
+
+/* Reverse_Strip()
+ *
+ * Swaps pixels cnt to end of the first half of an image with their
+ * mirror images in the last half, looking them up in lut if not NULL.
+ * Pixels are swapped 8 at a time, byte reversing 64 bit words
+ */
+static void Reverse_Strip(
+        uint8_t *image, uint32_t size, uint32_t cnt,
+        uint32_t end, const uint8_t *lut) {
+  uint64_t front, back;
+  uint8_t temp;
+
+  for( ; cnt + sizeof(uint64_t) <= end; cnt += sizeof(uint64_t) )
+  {
+    uint8_t *mirror = &image[ size - sizeof(uint64_t) - cnt ];
+
+    memcpy( &front, &image[cnt], sizeof(uint64_t) );
+    memcpy( &back,  mirror,      sizeof(uint64_t) );
+    if( lut != NULL )
+    {
+      front = Lut_Word( lut, front );
+      back  = Lut_Word( lut, back );
+    }
+    front = __builtin_bswap64( front );
+    back  = __builtin_bswap64( back );
+    memcpy( &image[cnt], &back, sizeof(uint64_t) );
+    memcpy( mirror, &front,     sizeof(uint64_t) );
+  }
+
+  for( ; cnt < end; cnt++ )
+  {
+    temp = image[ cnt ];
+    image[ cnt ] = image[ size - 1 - cnt ];
+    image[ size - 1 - cnt ] = temp;
+    if( lut != NULL )
+    {
+      image[ cnt ] = lut[ image[cnt] ];
+      image[ size - 1 - cnt ] = lut[ image[size - 1 - cnt] ];
+    }
+  }
+}
+
+/*****************************************************************************/
+
+/* Norm_Lut_Strip()
+ *
+ * Replaces the pixels of a strip of an image by their normalized
+ * values, strip idx % strips of image idx / strips. Pixels are
+ * looked up 8 at a time and stored as one 64 bit word. If the
+ * image is also flipped, strips are of its first half and are
+ * swapped with their mirror images on the way
+ */
+static void Norm_Lut_Strip(void *arg, int idx) {
+  norm_job_t *job = (norm_job_t *)arg;
+  int img = idx / job->strips, strip = idx % job->strips;
+  uint8_t *image = job->images[ img ];
+  const uint8_t *lut = job->lut[ img ];
+  uint32_t cnt, end, half = job->size / 2;
+  uint64_t word;
+
+  if( job->skip[img] ) return;
+
+  if( job->flip )
+  {
+    Reverse_Strip( image, job->size,
+        Strip_Start(half, job->strips, strip),
+        Strip_Start(half, job->strips, strip + 1), lut );
+
+    /* The middle pixel of odd sized images stays in place */
+    if( (job->size & 1) && (strip == job->strips - 1) )
+      image[ half ] = lut[ image[half] ];
+    return;
+  }
+
+  cnt = Strip_Start( job->size, job->strips, strip );
+  end = Strip_Start( job->size, job->strips, strip + 1 );
+  for( ; cnt + sizeof(uint64_t) <= end; cnt += sizeof(uint64_t) )
+  {
+    memcpy( &word, &image[cnt], sizeof(uint64_t) );
+    word = Lut_Word( lut, word );
+    memcpy( &image[cnt], &word, sizeof(uint64_t) );
+  }
+  for( ; cnt < end; cnt++ )
+    image[cnt] = lut[ image[cnt] ];
+}
+
+/*****************************************************************************/
+
+/*  Normalize_Images()
+ *
+ *  Does histogram (linear) normalization of num_images pgm (P5)
+ *  images of image_size pixels each, all in one pass over them.
+ *  image_hist holds the images' intensity histograms if already
+ *  built by an earlier pass over them, otherwise it is NULL.
+ *  If flip is true the images are also rotated by 180 degrees
+ *  in the same pass, as by Flip_Image()
+ */
+void Normalize_Images(
+        uint8_t *image_buffer[],
+        int num_images,
         uint32_t image_size,
         uint8_t range_low,
-        uint8_t range_high) {
+        uint8_t range_high,
+        uint32_t image_hist[][MAX_WHITE+1],
+        bool flip) {
   uint32_t
     hist[MAX_WHITE+1],  /* Intensity histogram of pgm image file  */
     pixel_cnt,          /* Total pixels counter for cut-off point */
@@ -58,6 +268,10 @@ void Normalize_Image(
     val_range_in,       /* Range of intensity values in input image  */
     val_range_out;      /* Range of intensity values in output image */
 
+  norm_job_t job;
+  int img, strip;
+  bool any = false;
+
   /* Abort for "empty" image buffers */
   if( image_size == 0 )
   {
@@ -68,64 +282,120 @@ void Normalize_Image(
     return;
   }
 
-  /* Clear histogram */
-  for( idx = 0; idx <= MAX_WHITE; idx++ )
-    hist[ idx ] = 0;
+  if( num_images > CHANNEL_IMAGE_NUM ) num_images = CHANNEL_IMAGE_NUM;
 
-  /* Build image intensity histogram */
-  for( idx = 0; idx < image_size; idx++ )
-    hist[ image_buffer[idx] ]++;
+  /* Build the images' intensity histograms, a strip at a time */
+  job.images = image_buffer;
+  job.size   = image_size;
+  job.strips = Pool_Strips( thread_pool, (int)image_size, STRIP_MIN_PIXELS );
+  job.hist   = NULL;
+  if( image_hist == NULL )
+  {
+    mem_alloc( (void **)&job.hist, (size_t)num_images *
+        (size_t)job.strips * (MAX_WHITE+1) * sizeof(uint32_t) );
+    Pool_For( thread_pool, num_images * job.strips, Norm_Hist_Strip, &job );
+  }
 
   /* Determine black/white cut-off counts */
   black_cutoff = (image_size * BLACK_CUT_OFF) / 100;
   white_cutoff = (image_size * WHITE_CUT_OFF) / 100;
+  val_range_out = range_high - range_low;
 
-  /* Find black cut-off intensity value. Values below
-   * MIN_BLACK are ignored to leave behind the black stripes
-   * that seem to be sent by the satellite occasionally */
-  pixel_cnt = 0;
-  for( black_min_in = MIN_BLACK; black_min_in != MAX_WHITE; black_min_in++ )
+  for( img = 0; img < num_images; img++ )
   {
-    pixel_cnt += hist[ black_min_in ];
-    if( pixel_cnt >= black_cutoff ) break;
-  }
+    for( idx = 0; idx <= MAX_WHITE; idx++ )
+    {
+      if( image_hist != NULL )
+        hist[ idx ] = image_hist[ img ][ idx ];
+      else
+      {
+        hist[ idx ] = 0;
+        for( strip = 0; strip < job.strips; strip++ )
+          hist[ idx ] +=
+            job.hist[ (img * job.strips + strip) * (MAX_WHITE+1) + idx ];
+      }
+    }
 
-  /* Find white cut-off intensity value */
-  pixel_cnt = 0;
-  for( white_max_in = MAX_WHITE; white_max_in != 0; white_max_in-- )
-  {
-    pixel_cnt += hist[ white_max_in ];
-    if( pixel_cnt >= white_cutoff ) break;
+    /* Find black cut-off intensity value. Values below
+     * MIN_BLACK are ignored to leave behind the black stripes
+     * that seem to be sent by the satellite occasionally */
+    pixel_cnt = 0;
+    for( black_min_in = MIN_BLACK; black_min_in != MAX_WHITE; black_min_in++ )
+    {
+      pixel_cnt += hist[ black_min_in ];
+      if( pixel_cnt >= black_cutoff ) break;
+    }
+
+    /* Find white cut-off intensity value */
+    pixel_cnt = 0;
+    for( white_max_in = MAX_WHITE; white_max_in != 0; white_max_in-- )
+    {
+      pixel_cnt += hist[ white_max_in ];
+      if( pixel_cnt >= white_cutoff ) break;
+    }
+
+    /* Rescale pixels in image for required intensity range */
+    val_range_in = white_max_in - black_min_in;
+    if( val_range_in == 0 )
+    {
+      Show_Message(
+          "Image seems flat\n"\
+            "Normalization not performed", "red" );
+      Error_Dialog();
+
+      /* Still to be flipped, with pixel values as they are */
+      job.skip[ img ] = !flip;
+      for( idx = 0; idx <= MAX_WHITE; idx++ )
+        job.lut[ img ][ idx ] = (uint8_t)idx;
+      continue;
+    }
+    job.skip[ img ] = false;
+    any = true;
+
+    for( idx = 0; idx <= MAX_WHITE; idx++ )
+    {
+      /* Input image pixel values relative to input black cut off.
+       * Clamp pixel values within black and white cut off values */
+      pixel_val_in  = (uint8_t)iClamp( (int)idx, black_min_in, white_max_in );
+      pixel_val_in -= black_min_in;
+
+      /* Normalized pixel values are scaled according to the ratio
+       * of required pixel value range to input pixel value range */
+      job.lut[ img ][ idx ] = (uint8_t)
+        ( range_low + (pixel_val_in * val_range_out) / val_range_in );
+    }
   }
+  free_ptr( (void **)&job.hist );
 
-  /* Rescale pixels in image for required intensity range */
-  val_range_in = white_max_in - black_min_in;
-  if( val_range_in == 0 )
+  /* Perform histogram normalization on images, a strip at a
+   * time, rotating them in the same pass if they are flipped */
+  job.flip = flip;
+  if( flip )
   {
-    Show_Message(
-        "Image seems flat\n"\
-          "Normalization not performed", "red" );
-    Error_Dialog();
-    return;
+    Show_Message( "Rotating Image by 180 degrees", "black" );
+    job.strips = Pool_Strips( thread_pool,
+        (int)(image_size / 2), STRIP_MIN_PIXELS );
   }
+  if( any )
+    Show_Message( "Performing Histogram Normalization", "black" );
+  if( any || flip )
+    Pool_For( thread_pool, num_images * job.strips, Norm_Lut_Strip, &job );
+}
 
-  /* Perform histogram normalization on images */
-  Show_Message( "Performing Histogram Normalization", "black" );
+/*****************************************************************************/
 
-  val_range_out = range_high - range_low;
-  for( pixel_cnt = 0; pixel_cnt < image_size; pixel_cnt++ )
-  {
-    /* Input image pixel values relative to input black cut off.
-     * Clamp pixel values within black and white cut off values */
-    pixel_val_in  = (uint8_t)
-      iClamp( image_buffer[pixel_cnt], black_min_in, white_max_in );
-    pixel_val_in -= black_min_in;
-
-    /* Normalized pixel values are scaled according to the ratio
-     * of required pixel value range to input pixel value range */
-    image_buffer[ pixel_cnt ] =
-      range_low + ( pixel_val_in * val_range_out ) / val_range_in;
-  }
+/* Flip_Strip()
+ *
+ * Swaps a strip of pixels of the first half of the
+ * image with their mirror images in the last half
+ */
+static void Flip_Strip(void *arg, int idx) {
+  flip_job_t *job = (flip_job_t *)arg;
+  uint32_t half = job->size / 2;
+
+  Reverse_Strip( job->image, job->size,
+      Strip_Start(half, job->strips, idx),
+      Strip_Start(half, job->strips, idx + 1), NULL );
 }
 
 /*****************************************************************************/
@@ -135,14 +405,7 @@ void Normalize_Image(
  *  Flips a pgm (P5) image by 180 degrees
  */
 void Flip_Image(uint8_t *image_buffer, uint32_t image_size) {
-  uint32_t idx; /* Index for loops etc */
-
-  uint8_t
-    *idx_temp,  /* Buffer location to be saved in temp    */
-    *idx_swap;  /* Buffer location to be swaped with temp */
-
-  /* Holds a pixel value temporarily */
-  uint8_t temp;
+  flip_job_t job;
 
   /* Abort for "empty" image buffers */
   if( image_size == 0 )
@@ -154,32 +417,42 @@ void Flip_Image(uint8_t *image_buffer, uint32_t image_size) {
     return;
   }
 
-  /* Rotate image 180 degrees */
+  /* Rotate image 180 degrees, swapping strips
+   * of its first half with the mirrored last half */
   Show_Message( "Rotating Image by 180 degrees", "black" );
-  for( idx = 0; idx < image_size / 2; idx++ )
-  {
-    idx_temp = image_buffer + idx;
-    idx_swap = image_buffer - 1 + image_size - idx;
-    temp = *( idx_temp );
-    *( idx_temp ) = *( idx_swap );
-    *( idx_swap ) = temp;
-  }
+  job.image  = image_buffer;
+  job.size   = image_size;
+  job.strips = Pool_Strips( thread_pool, (int)(image_size / 2), STRIP_MIN_PIXELS );
+  Pool_For( thread_pool, job.strips, Flip_Strip, &job );
 }
 
 /*****************************************************************************/
 
 /* Display_Scaled_Image
  *
- * Scales an LRPT image horizontal line by the scale
- * factor and stores the result in the image pixbuf
+ * Scales the LRPT image lines received since the last call by
+ * the scale factor and stores the result in the image pixbuf.
+ * Each band of scale lines is summed down its columns first and
+ * then across groups of scale columns. While receiving, the image
+ * widget is only updated every DISPLAY_UPDATE_USEC
  */
 void Display_Scaled_Image(uint8_t *chan_image[], uint32_t apid, int current_y) {
-  int chn, idx, idy, cnt, scale;
+  int chn, idy, cnt, scale, area;
   int scaled_width, scaled_x, scaled_idx;
   static int
     scaled_y[CHANNEL_IMAGE_NUM] = { 0, 0, 0 },
     last_y  [CHANNEL_IMAGE_NUM] = { 0, 0, 0 };
-  uint16_t *pix_val = NULL;
+
+  /* Column sums of a band of lines, kept between calls */
+  static uint16_t *col_sum = NULL;
+  static size_t col_sum_len = 0;
+
+  /* Time of the last update of the image widget */
+  static gint64 last_update = 0;
+  gint64 now;
+
+  const uint8_t *line;
+  uint32_t sum;
   guchar *pixel, val;
 
 
@@ -191,6 +464,7 @@ void Display_Scaled_Image(uint8_t *chan_image[], uint32_t apid, int current_y) {
       scaled_y[cnt] = 0;
       last_y[cnt]   = 0;
     }
+    last_update = 0;
 
     /* Fill pixbuf with background color */
     gdk_pixbuf_fill( scaled_image_pixbuf, 0xaaaaaaff );
@@ -205,6 +479,7 @@ void Display_Scaled_Image(uint8_t *chan_image[], uint32_t apid, int current_y) {
     scaled_width = METEOR_IMAGE_WIDTH / scale;
     scale = (int)channel_image_width / scaled_width + 1;
   }
+  area = scale * scale;
 
   /* Just in case the unscaled image height is too much */
   if( (current_y / scale) > scaled_image_height )
@@ -222,29 +497,27 @@ void Display_Scaled_Image(uint8_t *chan_image[], uint32_t apid, int current_y) {
   /* Length of pixel values buffer */
   scaled_width = (int)channel_image_width / scale;
 
-  /* Allocate pixel values buffer and clear */
-  size_t siz = (size_t)scaled_width * sizeof(uint16_t);
-  mem_alloc( (void **)&pix_val, siz );
+  /* (Re)allocate the column sums buffer if too short */
+  if( col_sum_len < channel_image_width )
+  {
+    col_sum_len = channel_image_width;
+    mem_realloc( (void **)&col_sum, col_sum_len * sizeof(uint16_t) );
+  }
 
   /* Keep scaling image while image size is enough */
   while( (current_y - last_y[chn]) >= scale )
   {
-    /* Clear line buffer for next summation */
-    bzero( pix_val, siz );
-
-    /* Index to channel image to start using pixel values */
-    idx = last_y[chn] * (int)channel_image_width;
-
-    /* Summate (scale * scale) pixel values from the channel image */
-    for( idy = 0; idy < scale; idy++ )
+    /* Summate the columns of scale lines of the channel image */
+    line = &chan_image[chn][ (size_t)last_y[chn] * channel_image_width ];
+    for( cnt = 0; cnt < (int)channel_image_width; cnt++ )
+      col_sum[cnt] = line[cnt];
+    for( idy = 1; idy < scale; idy++ )
     {
-      for( scaled_x = 0; scaled_x < scaled_width; scaled_x++ )
-      {
-        for( cnt = 0; cnt < scale; cnt++ )
-          pix_val[scaled_x] += (uint16_t)chan_image[chn][idx++];
-      }
-      last_y[chn]++;
+      line += channel_image_width;
+      for( cnt = 0; cnt < (int)channel_image_width; cnt++ )
+        col_sum[cnt] += line[cnt];
     }
+    last_y[chn] += scale;
 
     /* Fill scaled image buffer with scaled summed pixel values */
     int y =
@@ -252,9 +525,13 @@ void Display_Scaled_Image(uint8_t *chan_image[], uint32_t apid, int current_y) {
       (chn * scaled_width + chn) * scaled_image_n_channels;
     for( scaled_x = 0; scaled_x < scaled_width; scaled_x++ )
     {
+      sum = 0;
+      for( cnt = scaled_x * scale; cnt < (scaled_x + 1) * scale; cnt++ )
+        sum += col_sum[cnt];
+
       scaled_idx = scaled_x * scaled_image_n_channels + y;
       pixel = &scaled_image_pixel_buf[scaled_idx];
-      val = (guchar)(pix_val[scaled_x] / (uint16_t)scale / (uint16_t)scale);
+      val = (guchar)( sum / (uint32_t)area );
       pixel[0] = val;
       pixel[1] = val;
       pixel[2] = val;
@@ -271,29 +548,65 @@ void Display_Scaled_Image(uint8_t *chan_image[], uint32_t apid, int current_y) {
     scaled_y[chn]++;
 
   } /* while( (current_y - last_y) >= rc_data.image_scale ) */
-  free_ptr( (void **)&pix_val );
 
-  /* Set lrpt image from pixbuff */
+  /* Set lrpt image from pixbuff, not too often while receiving */
+  now = g_get_monotonic_time();
+  if( isFlagSet(STATUS_RECEIVING) &&
+      (now - last_update < DISPLAY_UPDATE_USEC) )
+    return;
+  last_update = now;
   gtk_image_set_from_pixbuf( GTK_IMAGE(lrpt_image), scaled_image_pixbuf );
 }
 
 /*****************************************************************************/
 
+/* Combo_Strip()
+ *
+ * Combines a strip of pixels of the channel images into the
+ * combo image, cloudy pixels being replaced by blue channel grey
+ */
+static void Combo_Strip(void *arg, int idx) {
+  combo_job_t *job = (combo_job_t *)arg;
+  uint32_t cnt, end;
+  uint8_t *combo, red, green, blue, cloud;
+
+  end   = Strip_Start( job->size, job->strips, idx + 1 );
+  cnt   = Strip_Start( job->size, job->strips, idx );
+  combo = &job->combo[ 3 * (size_t)cnt ];
+  for( ; cnt < end; cnt++ )
+  {
+    red   = job->lut[RED  ][ job->red[cnt]   ];
+    green = job->lut[GREEN][ job->green[cnt] ];
+    blue  = job->lut[BLUE ][ job->blue[cnt]  ];
+    cloud = job->cloud[ job->blue[cnt] ];
+
+    *combo++ = (uint8_t)( (red   & ~cloud) | (blue & cloud) );
+    *combo++ = (uint8_t)( (green & ~cloud) | (blue & cloud) );
+    *combo++ = blue;
+  }
+}
+
+/*****************************************************************************/
+
 /* Create_Combo_Image()
  *
  * Combines channel images into one combined pseudo-color image.
  * If enabled, it performs some speculative enhancement of watery
- * areas and clouds.
+ * areas and clouds. Each channel is mapped by a lookup table, so
+ * the channel images themselves are left as they are.
  */
 void Create_Combo_Image(uint8_t *combo_image) {
     /* Color channels are 0 = red, 1 = green, 2 = blue
      * but it all depends on the APID options in glrptrc */
-    uint32_t idx = 0, cnt;
+    combo_job_t job;
     uint8_t range_red, range_green, range_blue;
-    uint8_t
-        red   = rc_data.color_channel[RED],
-        green = rc_data.color_channel[GREEN],
-        blue  = rc_data.color_channel[BLUE];
+    int val;
+
+    job.combo = combo_image;
+    job.red   = channel_image[ rc_data.color_channel[RED]   ];
+    job.green = channel_image[ rc_data.color_channel[GREEN] ];
+    job.blue  = channel_image[ rc_data.color_channel[BLUE]  ];
+    job.size  = (uint32_t)channel_image_size;
 
     /* Perform speculative enhancement of watery areas and clouds */
     if( isFlagSet(IMAGE_COLORIZE) )
@@ -313,43 +626,30 @@ void Create_Combo_Image(uint8_t *combo_image) {
          * ~/glrpt/glrptrc configuration file */
         range_blue = rc_data.colorize_blue_max - rc_data.colorize_blue_min;
 
-        for( cnt = 0; cnt < channel_image_size; cnt++ )
+        for( val = 0; val <= MAX_WHITE; val++ )
         {
+            /* Reduce Red channel luminance as specified in config file */
+            job.lut[RED][val] = (uint8_t)
+                ( rc_data.norm_range[RED][NORM_RANGE_BLACK] +
+                  (val * range_red) / MAX_WHITE );
+            job.lut[GREEN][val] = (uint8_t)val;
+
             /* Progressively raise the value of blue channel
              * pixels in the dark areas to counteract the
              * effects of histogram equalization, which darkens
              * the parts of the image that are watery areas */
-            if( isFlagClear(IMAGE_COLORIZED) )
-            {
-                if( channel_image[blue][cnt] < rc_data.colorize_blue_min )
-                {
-                    channel_image[blue][cnt] =
-                        rc_data.colorize_blue_min  +
-                        ( channel_image[blue][cnt] * range_blue ) /
-                        rc_data.colorize_blue_max;
-                }
-
-                SetFlag( IMAGE_COLORIZED );
-            }
+            job.lut[BLUE][val] = (uint8_t)val;
+            if( (val < rc_data.colorize_blue_min) &&
+                (rc_data.colorize_blue_max != 0) )
+                job.lut[BLUE][val] = (uint8_t)
+                    ( rc_data.colorize_blue_min +
+                      (val * range_blue) / rc_data.colorize_blue_max );
 
             /* Colorize cloudy areas white pseudocolor. This helps
              * because the red channel does not render clouds right */
-            if( channel_image[blue][cnt] > rc_data.clouds_threshold )
-            {
-                combo_image[idx++] = channel_image[blue][cnt];
-                combo_image[idx++] = channel_image[blue][cnt];
-                combo_image[idx++] = channel_image[blue][cnt];
-            }
-            else /* Just combine channels */
-            {
-                /* Reduce Red channel luminance as specified in config file */
-                combo_image[idx++] = rc_data.norm_range[RED][NORM_RANGE_BLACK] +
-                    ( channel_image[red][cnt] * range_red ) / MAX_WHITE;
-                combo_image[idx++] = channel_image[green][cnt];
-                combo_image[idx++] = channel_image[blue][cnt];
-            }
-        } /* for( cnt = 0; cnt < (int)channel_image_size; cnt++ ) */
-
+            job.cloud[val] =
+                ( job.lut[BLUE][val] > rc_data.clouds_threshold ) ? 0xff : 0;
+        }
     } /* if( isFlagSet(IMAGE_COLORIZE) ) */
     else
     {
@@ -365,14 +665,22 @@ void Create_Combo_Image(uint8_t *combo_image) {
             rc_data.norm_range[BLUE][NORM_RANGE_WHITE] -
             rc_data.norm_range[BLUE][NORM_RANGE_BLACK];
 
-        for( cnt = 0; cnt < channel_image_size; cnt++ )
+        for( val = 0; val <= MAX_WHITE; val++ )
         {
-            combo_image[idx++] = rc_data.norm_range[RED][NORM_RANGE_BLACK] +
-                ( channel_image[red][cnt] * range_red ) / MAX_WHITE;
-            combo_image[idx++] = rc_data.norm_range[GREEN][NORM_RANGE_BLACK] +
-                ( channel_image[green][cnt] * range_green ) / MAX_WHITE;
-            combo_image[idx++] = rc_data.norm_range[BLUE][NORM_RANGE_BLACK] +
-                ( channel_image[blue][cnt] * range_blue ) / MAX_WHITE;
-        } /* for( cnt = 0; cnt < (int)channel_image_size; cnt++ ) */
+            job.lut[RED][val] = (uint8_t)
+                ( rc_data.norm_range[RED][NORM_RANGE_BLACK] +
+                  (val * range_red) / MAX_WHITE );
+            job.lut[GREEN][val] = (uint8_t)
+                ( rc_data.norm_range[GREEN][NORM_RANGE_BLACK] +
+                  (val * range_green) / MAX_WHITE );
+            job.lut[BLUE][val] = (uint8_t)
+                ( rc_data.norm_range[BLUE][NORM_RANGE_BLACK] +
+                  (val * range_blue) / MAX_WHITE );
+            job.cloud[val] = 0;
+        }
     }
+
+    /* Combine the channel images a strip at a time */
+    job.strips = Pool_Strips( thread_pool, (int)job.size, STRIP_MIN_PIXELS );
+    Pool_For( thread_pool, job.strips, Combo_Strip, &job );
 }
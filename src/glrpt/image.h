@@ -19,6 +19,7 @@
 
 /*****************************************************************************/
 
+#include <stdbool.h>
 #include <stdint.h>
 
 /*****************************************************************************/
@@ -38,11 +39,14 @@
 
 /*****************************************************************************/
 
-void Normalize_Image(
-        uint8_t *image_buffer,
+void Normalize_Images(
+        uint8_t *image_buffer[],
+        int num_images,
         uint32_t image_size,
         uint8_t range_low,
-        uint8_t range_high);
+        uint8_t range_high,
+        uint32_t image_hist[][MAX_WHITE+1],
+        bool flip);
 void Flip_Image(uint8_t *image_buffer, uint32_t image_size);
 void Display_Scaled_Image(uint8_t *chan_image[], uint32_t apid, int current_y);
 void Create_Combo_Image(uint8_t *combo_image);
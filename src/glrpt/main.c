@@ -15,6 +15,7 @@
 /*****************************************************************************/
 
 #include "../common/shared.h"
+#include "../common/thread_pool.h"
 #include "../sdr/filters.h"
 #include "../sdr/ifft.h"
 #include "callback_func.h"
@@ -105,6 +106,9 @@ int main(int argc, char *argv[]) {
     rc_data.ifft_decimate = IFFT_DECIMATE;
     rc_data.satellite_name[0] = '\0';
 
+    /* Start the image decoding worker threads */
+    thread_pool = Pool_Init(0);
+
     /* Create glrpt main window */
     main_window = create_main_window(&main_window_builder);
     gtk_window_set_title(GTK_WINDOW(main_window), PACKAGE_STRING);
@@ -186,6 +190,9 @@ int main(int argc, char *argv[]) {
     /* Main loop */
     gtk_main();
 
+    /* Finish any queued decoding jobs and stop the workers */
+    Pool_Deinit(&thread_pool);
+
     return 0;
 }
 